@@ -0,0 +1,982 @@
+#include "Benchmarks.hpp"
+#include "ChunkCache.hpp"
+#include "ChunkMap.hpp"
+#include "IndirectDrawList.hpp"
+#include "PriorityExecutor.hpp"
+#include "SurfaceExtractor.hpp"
+#include "TerrainGenerator.hpp"
+#include "ThreadTopology.hpp"
+#include "TlsfAllocator.hpp"
+#include "metrics.hpp"
+#include "taskflow\taskflow.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace
+{
+  // Heap allocations made by each thread, for checks which mustn't allocate. Per thread so
+  // the rest of the app pays for a plain increment, not an atomic on every allocation
+  thread_local uint64_t threadAllocations = 0;
+}
+
+void * operator new(size_t const size)
+{
+  threadAllocations++;
+  if (void * const p = std::malloc(size > 0 ? size : 1)) return p;
+  throw std::bad_alloc();
+}
+
+void * operator new[](size_t const size)
+{
+  return operator new(size);
+}
+
+void operator delete(void * const p) noexcept
+{
+  std::free(p);
+}
+
+void operator delete[](void * const p) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void * const p, size_t) noexcept
+{
+  std::free(p);
+}
+
+void operator delete[](void * const p, size_t) noexcept
+{
+  std::free(p);
+}
+
+namespace
+{
+  // Runs fn(threadIndex) on threadCount threads released at the same time, returns the wall time in seconds
+  template<class Fn>
+  double timeThreads(unsigned int const threadCount, Fn fn)
+  {
+    std::atomic<bool> go(false);
+    std::vector<std::thread> threads;
+    for (unsigned int i = 0; i < threadCount; i++)
+    {
+      threads.emplace_back([&, i]() {
+        while (!go.load(std::memory_order_acquire)) std::this_thread::yield();
+        fn(i);
+      });
+    }
+
+    tp start = hr_clock::now();
+    go.store(true, std::memory_order_release);
+    for (auto & thread : threads)
+    {
+      thread.join();
+    }
+    return duration_cast<nanoseconds>(hr_clock::now() - start).count() * 1e-9;
+  }
+
+  // 1, 2, 4... up to and including every hardware thread
+  std::vector<unsigned int> threadCounts()
+  {
+    unsigned int const maxThreads = std::max(std::thread::hardware_concurrency(), 1u);
+    std::vector<unsigned int> counts;
+    for (unsigned int count = 1; count < maxThreads; count *= 2)
+    {
+      counts.push_back(count);
+    }
+    counts.push_back(maxThreads);
+    return counts;
+  }
+
+  // p (0 to 1) of an already sorted, non-empty list, nearest rank below. Every benchmark
+  // takes its percentiles here so their logs can be compared
+  template<class T>
+  T percentile(std::vector<T> const & sorted, double const p)
+  {
+    return sorted[static_cast<size_t>(p * (sorted.size() - 1))];
+  }
+
+  // What sharing the cache looks like without sharding, one lock around the whole thing
+  class LockedChunkCache
+  {
+  public:
+    LockedChunkCache(size_t const budgetBytes)
+      : cache(budgetBytes)
+    {}
+
+    void add(KeyType const key, ChunkCacheData && data)
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      cache.add(key, std::move(data));
+    }
+
+    bool retrieve(KeyType const key, ChunkCacheData & data)
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      return cache.retrieve(key, data);
+    }
+
+  private:
+    std::mutex mutex;
+    BasicChunkCache<ARCPolicy<KeyType>> cache;
+  };
+
+  // Workers take an entry if it's cached (a reload), build a new one if it isn't
+  // (a generation) and put it back (an unload). Budget holds about half the keys
+  template<class Cache>
+  double cacheOpsPerSecond(unsigned int const threadCount)
+  {
+    constexpr uint32_t opsPerThread = 200000;
+    constexpr uint32_t keySpace = 8192;
+    constexpr uint32_t runsPerEntry = 64;
+
+    ChunkCacheData sample;
+    sample.volume.runs.resize(runsPerEntry);
+    Cache cache(cacheEntryCost(sample) * keySpace / 2);
+
+    double seconds = timeThreads(threadCount, [&](unsigned int const thread) {
+      std::mt19937_64 rng(thread);
+      for (uint32_t i = 0; i < opsPerThread; i++)
+      {
+        KeyType key = rng() % keySpace;
+        ChunkCacheData data;
+        if (!cache.retrieve(key, data))
+        {
+          data.volume.runs.resize(runsPerEntry);
+        }
+        cache.add(key, std::move(data));
+      }
+    });
+
+    return static_cast<double>(threadCount) * opsPerThread / seconds;
+  }
+
+  bool benchCache(std::ofstream & log)
+  {
+    log << "cache,threads,opsPerSecond" << std::endl;
+    for (unsigned int threads : threadCounts())
+    {
+      double single = cacheOpsPerSecond<LockedChunkCache>(threads);
+      double sharded = cacheOpsPerSecond<ChunkCache>(threads);
+
+      log << "single," << threads << "," << single << std::endl;
+      log << "sharded," << threads << "," << sharded << std::endl;
+      syncout() << threads << " threads: single lock " << single << " ops/s, " << ChunkCacheShards << " shards " << sharded << " ops/s" << std::endl;
+    }
+    return true;
+  }
+
+  // Not a timing run, checks chunk data goes through the cache without being copied.
+  // Fills the cache, then every cycle retrieves each chunk and adds it back like a
+  // load and unload. A payload buffer (the volume's runs, the mesh's vertex and index
+  // data) still at the same address after the round trip was moved, anywhere else was
+  // copied. Once warm the cycles mustn't copy anything or allocate at all
+  bool checkCacheMoves(std::ofstream & log)
+  {
+    constexpr uint32_t keyCount = 1024, cycles = 16;
+
+    struct Payload
+    {
+      VoxelRun const * runs;
+      unsigned char const * vertexData;
+      unsigned char const * indexData;
+    };
+    auto payloadOf = [](ChunkCacheData const & data) {
+      return Payload{ data.volume.runs.data(), data.mesh.vertexData.data(), data.mesh.indexData.data() };
+    };
+
+    ChunkCacheData sample;
+    sample.volume.runs.resize(256);
+    sample.mesh.built = true;
+    sample.mesh.vertexData.resize(4096);
+    sample.mesh.indexData.resize(1024);
+    ChunkCache cache(cacheEntryCost(sample) * keyCount * 2); // Room enough that nothing is evicted
+
+    std::vector<Payload> payloads(keyCount);
+    uint64_t const fillStart = threadAllocations;
+    for (uint32_t key = 0; key < keyCount; key++)
+    {
+      ChunkCacheData data;
+      data.volume.runs.resize(sample.volume.runs.size());
+      data.mesh.built = true;
+      data.mesh.vertexData.resize(sample.mesh.vertexData.size());
+      data.mesh.indexData.resize(sample.mesh.indexData.size());
+      payloads[key] = payloadOf(data);
+      cache.add(key, std::move(data));
+    }
+    uint64_t const fillAllocations = threadAllocations - fillStart;
+
+    uint64_t hits = 0, moved = 0, copied = 0;
+    ChunkCacheData data;
+    uint64_t const cyclesStart = threadAllocations;
+    for (uint32_t cycle = 0; cycle < cycles; cycle++)
+    {
+      for (uint32_t key = 0; key < keyCount; key++)
+      {
+        if (!cache.retrieve(key, data)) continue;
+        hits++;
+        Payload const payload = payloadOf(data);
+        uint32_t const same = (payload.runs == payloads[key].runs) + (payload.vertexData == payloads[key].vertexData) + (payload.indexData == payloads[key].indexData);
+        moved += same;
+        copied += 3 - same;
+        cache.add(key, std::move(data));
+      }
+    }
+    uint64_t const cycleAllocations = threadAllocations - cyclesStart;
+
+    bool const passed = hits == uint64_t(keyCount) * cycles && copied == 0 && cycleAllocations == 0;
+    log << "result,keys,cycles,fillAllocations,hits,payloadMoved,payloadCopied,cycleAllocations" << std::endl;
+    log << (passed ? "passed," : "failed,") << keyCount << "," << cycles << "," << fillAllocations << "," << hits << "," << moved << "," << copied << "," << cycleAllocations << std::endl;
+    syncout() << "Cache moves " << (passed ? "passed: " : "failed: ") << hits << " hits, " << moved << " payload buffers moved, " << copied << " copied, "
+      << cycleAllocations << " allocations over " << cycles << " retrieve and add cycles (" << fillAllocations << " filling the cache)" << std::endl;
+    return passed;
+  }
+
+  // The ChunkMap before it was a ring buffer, for comparison
+  class HashedChunkMap
+  {
+  public:
+    bool isChunkLoaded(ChunkCoord const coord) const { return map.count(chunkKey(coord)) == 1; }
+    void loadChunk(ChunkCoord const coord, EntityHandle const entity) { map[chunkKey(coord)] = entity; }
+    EntityHandle unloadChunk(ChunkCoord const coord)
+    {
+      KeyType key = chunkKey(coord);
+      EntityHandle handle = map.at(key);
+      map.erase(key);
+      return handle;
+    }
+
+  private:
+    std::unordered_map<KeyType, EntityHandle> map;
+  };
+
+  struct MapTimings
+  {
+    double lookupNs;
+    double insertNs;
+    double unloadNs;
+  };
+
+  // Walks the player along x round the whole world, each step checks every chunk in
+  // the spawn sphere (like a full spawn sweep), loads the ones which have come into
+  // range and unloads the ones which have dropped out behind
+  template<class Map>
+  MapTimings timeChunkMap()
+  {
+    constexpr int32_t laps = 20;
+    std::vector<ChunkCoord> const offsets = sphereOffsets(chunkSpawnDistance);
+    int32_t const radius = static_cast<int32_t>(chunkSpawnDistance);
+
+    auto map = std::make_unique<Map>();
+    uint64_t lookups = 0, inserts = 0, unloads = 0;
+    nanoseconds lookupTime(0), insertTime(0), unloadTime(0);
+    EntityHandle nextHandle = 0;
+    uint64_t found = 0;
+
+    std::vector<ChunkCoord> missing;
+    for (int32_t step = 0; step < laps * static_cast<int32_t>(WorldDimension); step++)
+    {
+      ChunkCoord centre = { wrapChunkAxis(step), 0, 0 };
+
+      missing.clear();
+      tp start = hr_clock::now();
+      for (auto const & offset : offsets)
+      {
+        ChunkCoord coord = wrapChunkCoord(centre + offset);
+        if (map->isChunkLoaded(coord)) found++;
+        else missing.push_back(coord);
+      }
+      lookupTime += duration_cast<nanoseconds>(hr_clock::now() - start);
+      lookups += offsets.size();
+
+      start = hr_clock::now();
+      for (auto const & coord : missing)
+      {
+        map->loadChunk(coord, nextHandle++);
+      }
+      insertTime += duration_cast<nanoseconds>(hr_clock::now() - start);
+      inserts += missing.size();
+
+      // The slice radius chunks behind the player leaves the sphere
+      ChunkCoord behind = { wrapChunkAxis(step - radius), 0, 0 };
+      start = hr_clock::now();
+      for (auto const & offset : offsets)
+      {
+        if (offset.x != 0) continue;
+        ChunkCoord coord = wrapChunkCoord(behind + offset);
+        if (map->isChunkLoaded(coord))
+        {
+          map->unloadChunk(coord);
+          unloads++;
+        }
+      }
+      unloadTime += duration_cast<nanoseconds>(hr_clock::now() - start);
+    }
+
+    if (found == 0) syncout() << "Map benchmark found nothing loaded" << std::endl; // Keeps the lookups from being optimised out
+
+    return {
+      static_cast<double>(lookupTime.count()) / static_cast<double>(lookups),
+      static_cast<double>(insertTime.count()) / static_cast<double>(std::max<uint64_t>(inserts, 1)),
+      static_cast<double>(unloadTime.count()) / static_cast<double>(std::max<uint64_t>(unloads, 1))
+    };
+  }
+
+  bool benchMap(std::ofstream & log)
+  {
+    log << "map,lookupNs,insertNs,unloadNs" << std::endl;
+    MapTimings hashed = timeChunkMap<HashedChunkMap>();
+    MapTimings ring = timeChunkMap<ChunkMap>();
+
+    log << "hashed," << hashed.lookupNs << "," << hashed.insertNs << "," << hashed.unloadNs << std::endl;
+    log << "ring," << ring.lookupNs << "," << ring.insertNs << "," << ring.unloadNs << std::endl;
+    syncout() << "unordered_map: lookup " << hashed.lookupNs << "ns, insert " << hashed.insertNs << "ns, unload " << hashed.unloadNs << "ns" << std::endl;
+    syncout() << "ring buffer:   lookup " << ring.lookupNs << "ns, insert " << ring.insertNs << "ns, unload " << ring.unloadNs << "ns" << std::endl;
+    return true;
+  }
+
+  // Chunks straddling the heightmap surface, so every one has something to mesh
+  std::vector<std::unique_ptr<ChunkVolume>> surfaceVolumes()
+  {
+    constexpr int32_t chunksX = 16, chunksZ = 4;
+    TerrainGenerator terrainGen;
+    terrainGen.SetSeed(4422);
+    std::vector<std::unique_ptr<ChunkVolume>> volumes;
+    for (int32_t z = 0; z < chunksZ; z++)
+    {
+      for (int32_t x = 0; x < chunksX; x++)
+      {
+        float height = terrainGen.surfaceHeight(chunkWorldPos({ x, 0, z }));
+        int32_t y = static_cast<int32_t>(std::floor(height * invTechnicalChunkDim));
+        volumes.push_back(std::make_unique<ChunkVolume>());
+        terrainGen.getChunkVolume(chunkWorldPos({ x, y, z }), *volumes.back());
+      }
+    }
+    return volumes;
+  }
+
+  // Meshes a fixed set of surface chunks on every worker at once, like the mesh, optimise
+  // and normals stages of chunk builds, which read the build's own volume without taking
+  // any lock. Throughput should rise with the thread count until it runs out of cores
+  bool benchMesh(std::ofstream & log)
+  {
+    constexpr uint32_t meshesPerThread = 64;
+    std::vector<std::unique_ptr<ChunkVolume>> volumes = surfaceVolumes();
+
+    // buildMesh is CPU only, none of the device side is touched
+    SurfaceExtractor extractor(nullptr, nullptr, nullptr, nullptr, nullptr, nullptr);
+
+    log << "threads,meshesPerSecond,speedup" << std::endl;
+    double single = 0.0;
+    for (unsigned int threads : threadCounts())
+    {
+      std::atomic<uint64_t> triangles(0);
+      double seconds = timeThreads(threads, [&](unsigned int const thread) {
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+        uint64_t built = 0;
+        for (uint32_t i = 0; i < meshesPerThread; i++)
+        {
+          if (extractor.buildMesh(*volumes[(thread + i) % volumes.size()], vertices, indices))
+          {
+            built += indices.size() / 3;
+          }
+        }
+        triangles += built;
+      });
+
+      double meshesPerSecond = static_cast<double>(threads) * meshesPerThread / seconds;
+      if (threads == 1) single = meshesPerSecond;
+      double speedup = meshesPerSecond / single;
+
+      log << threads << "," << meshesPerSecond << "," << speedup << std::endl;
+      syncout() << threads << " threads: " << meshesPerSecond << " meshes/s (" << speedup << "x), "
+        << triangles.load() / (static_cast<uint64_t>(threads) * meshesPerThread) << " triangles per mesh" << std::endl;
+    }
+    return true;
+  }
+
+  // Stands in for a task's work without letting the worker sleep
+  void spinFor(uint32_t const us)
+  {
+    tp const end = hr_clock::now() + microseconds(us);
+    while (hr_clock::now() < end) {}
+  }
+
+  struct TaskSample
+  {
+    TaskPriority priority;
+    tp submitted;
+    uint64_t waitUs; // Submitted to started
+  };
+
+  void reportWaits(std::ofstream & log, char const * const executor, std::vector<TaskSample> const & samples)
+  {
+    for (size_t level = 0; level < TaskPriorityCount; level++)
+    {
+      std::vector<uint64_t> waits;
+      for (auto const & sample : samples)
+      {
+        if (static_cast<size_t>(sample.priority) == level) waits.push_back(sample.waitUs);
+      }
+      if (waits.empty()) continue;
+      std::sort(waits.begin(), waits.end());
+
+      log << executor << "," << TaskPriorityNames[level] << "," << percentile(waits, 0.5) << "," << percentile(waits, 0.99) << "," << waits.back() << std::endl;
+      syncout() << executor << " " << TaskPriorityNames[level] << ": wait p50 " << percentile(waits, 0.5) << "us, p99 "
+        << percentile(waits, 0.99) << "us, max " << waits.back() << "us" << std::endl;
+    }
+  }
+
+  // Frames of work like the update thread hands out: a burst of prefetches submitted first,
+  // then the chunk jobs the camera is waiting on, then a housekeeping task, at about 60%
+  // load. The taskflow runs a frame's tasks in whatever order it likes, so chunk jobs
+  // wait behind prefetches. The priority executor should start them almost straight away
+  // without the other two levels' worst case waits running away
+  bool benchExecutor(std::ofstream & log)
+  {
+    constexpr uint32_t frames = 250, frameUs = 4000;
+    constexpr uint32_t chunkTasks = 4, chunkUs = 200, prefetchUs = 1200, housekeepingUs = 1000;
+    uint32_t const workers = std::max(std::thread::hardware_concurrency(), 2u) - 1; // One core left for the submitting thread
+    uint32_t const prefetchTasks = workers * 2;
+    uint32_t const perFrame = prefetchTasks + chunkTasks + 1;
+
+    auto priorityOf = [&](uint32_t const i) {
+      if (i < prefetchTasks) return TaskPriority::Prefetch;
+      if (i < prefetchTasks + chunkTasks) return TaskPriority::Chunk;
+      return TaskPriority::Housekeeping;
+    };
+    auto workOf = [&](TaskPriority const priority) {
+      if (priority == TaskPriority::Chunk) return chunkUs;
+      if (priority == TaskPriority::Prefetch) return prefetchUs;
+      return housekeepingUs;
+    };
+
+    log << "executor,priority,waitP50Us,waitP99Us,waitMaxUs" << std::endl;
+    std::vector<TaskSample> samples(static_cast<size_t>(frames) * perFrame);
+    {
+      tf::Taskflow taskflow(workers);
+      tp nextFrame = hr_clock::now();
+      for (uint32_t frame = 0; frame < frames; frame++)
+      {
+        size_t const first = static_cast<size_t>(frame) * perFrame;
+        for (uint32_t i = 0; i < perFrame; i++)
+        {
+          TaskSample & sample = samples[first + i];
+          sample.priority = priorityOf(i);
+          uint32_t const work = workOf(sample.priority);
+          taskflow.emplace([&sample, work]() {
+            sample.waitUs = duration_cast<microseconds>(hr_clock::now() - sample.submitted).count();
+            spinFor(work);
+          });
+        }
+        tp const submitted = hr_clock::now();
+        for (uint32_t i = 0; i < perFrame; i++)
+        {
+          samples[first + i].submitted = submitted;
+        }
+        taskflow.dispatch();
+
+        nextFrame += microseconds(frameUs);
+        std::this_thread::sleep_until(nextFrame);
+      }
+      taskflow.wait_for_all();
+    }
+    reportWaits(log, "taskflow", samples);
+
+    {
+      PriorityExecutor executor(workers, ExecutorStarvationLimit);
+      tp nextFrame = hr_clock::now();
+      for (uint32_t frame = 0; frame < frames; frame++)
+      {
+        size_t const first = static_cast<size_t>(frame) * perFrame;
+        for (uint32_t i = 0; i < perFrame; i++)
+        {
+          TaskSample & sample = samples[first + i];
+          sample.priority = priorityOf(i);
+          uint32_t const work = workOf(sample.priority);
+          sample.submitted = hr_clock::now();
+          executor.submit(sample.priority, [&sample, work]() {
+            sample.waitUs = duration_cast<microseconds>(hr_clock::now() - sample.submitted).count();
+            spinFor(work);
+          });
+        }
+
+        nextFrame += microseconds(frameUs);
+        std::this_thread::sleep_until(nextFrame);
+      }
+      executor.waitForAll();
+
+      TaskPriorityStats chunkStats = executor.getStats(TaskPriority::Chunk);
+      syncout() << chunkStats.stolen << " of " << chunkStats.completed << " chunk tasks stolen" << std::endl;
+    }
+    reportWaits(log, "priority", samples);
+    return true;
+  }
+
+  // Fixed amount of arithmetic standing in for a frame's work. Unlike spinFor it takes
+  // longer when its thread is preempted or shares a core, which is what's being measured
+  uint64_t frameWork(uint64_t const iterations)
+  {
+    uint64_t x = 88172645463325252ull;
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+      x ^= x << 13;
+      x ^= x >> 7;
+      x ^= x << 17;
+    }
+    return x;
+  }
+
+  // A frame thread doing a fixed amount of work every 4ms while every chunk worker meshes
+  // flat out, for each thread layout. Reserving and pinning cores should bring the frame
+  // thread's jitter down, ideally for little or no loss of meshing throughput
+  bool benchTopology(std::ofstream & log)
+  {
+    constexpr uint32_t frames = 500, frameUs = 4000, frameWorkUs = 1000;
+    std::vector<std::unique_ptr<ChunkVolume>> volumes = surfaceVolumes();
+    SurfaceExtractor extractor(nullptr, nullptr, nullptr, nullptr, nullptr, nullptr);
+
+    // Size the frame's work to take frameWorkUs on an idle machine
+    uint64_t iterations = 1 << 20;
+    tp calibrateStart = hr_clock::now();
+    volatile uint64_t sink = frameWork(iterations);
+    double calibrateUs = static_cast<double>(duration_cast<nanoseconds>(hr_clock::now() - calibrateStart).count()) * 1e-3;
+    iterations = std::max(static_cast<uint64_t>(iterations * frameWorkUs / std::max(calibrateUs, 1.0)), uint64_t(1));
+
+    ThreadTopologyConfig const layouts[] = {
+      { 0, false, false },                  // Chunk workers on every core
+      { ReservedFrameCores, false, false },
+      { ReservedFrameCores, true, false },
+      { ReservedFrameCores, true, true }
+    };
+
+    log << "topology,chunkWorkers,frameP50Us,frameP99Us,frameJitterUs,meshesPerSecond" << std::endl;
+    for (auto const & layout : layouts)
+    {
+      ThreadTopology topology(layout);
+      std::atomic<bool> stop(false);
+      std::atomic<uint64_t> meshes(0);
+      std::vector<uint64_t> frameTimes;
+      double seconds;
+      {
+        PriorityExecutor executor(topology.chunkWorkers(), ExecutorStarvationLimit,
+          [&](uint32_t const worker) { topology.pinChunkWorker(worker); });
+        for (uint32_t worker = 0; worker < executor.numWorkers(); worker++)
+        {
+          executor.submit(TaskPriority::Chunk, [&, worker]() {
+            std::vector<Vertex> vertices;
+            std::vector<uint32_t> indices;
+            for (uint32_t i = worker; !stop.load(std::memory_order_relaxed); i++)
+            {
+              extractor.buildMesh(*volumes[i % volumes.size()], vertices, indices);
+              meshes.fetch_add(1, std::memory_order_relaxed);
+            }
+          });
+        }
+
+        tp start = hr_clock::now();
+        std::thread frameThread([&]() {
+          topology.pinFrameThread();
+          tp nextFrame = hr_clock::now();
+          for (uint32_t frame = 0; frame < frames; frame++)
+          {
+            tp frameStart = hr_clock::now();
+            sink = frameWork(iterations);
+            frameTimes.push_back(duration_cast<microseconds>(hr_clock::now() - frameStart).count());
+            nextFrame += microseconds(frameUs);
+            std::this_thread::sleep_until(nextFrame);
+          }
+        });
+        frameThread.join();
+        seconds = duration_cast<nanoseconds>(hr_clock::now() - start).count() * 1e-9;
+        stop = true;
+      }
+
+      double mean = 0.0, variance = 0.0;
+      for (uint64_t time : frameTimes) mean += static_cast<double>(time);
+      mean /= frameTimes.size();
+      for (uint64_t time : frameTimes) variance += (time - mean) * (time - mean);
+      double jitterUs = std::sqrt(variance / frameTimes.size());
+      std::sort(frameTimes.begin(), frameTimes.end());
+      uint64_t p50 = percentile(frameTimes, 0.5), p99 = percentile(frameTimes, 0.99);
+      double meshesPerSecond = meshes.load() / seconds;
+
+      log << topology.name() << "," << topology.chunkWorkers() << "," << p50 << "," << p99 << "," << jitterUs << "," << meshesPerSecond << std::endl;
+      syncout() << topology.name() << " (" << topology.chunkWorkers() << " workers): frame p50 " << p50 << "us, p99 " << p99
+        << "us, jitter " << jitterUs << "us, " << meshesPerSecond << " meshes/s" << std::endl;
+    }
+    return true;
+  }
+
+  // Chunks spawning and despawning at random through one vertex page of the chunk buffer
+  // pool, at a few levels of fill, with mesh sizes taken from real surface chunks. Allocation
+  // latency should stay flat however full and fragmented the page gets, and compacting with
+  // a frame's worth of moves at a time should pull the free space back together
+  bool benchHeap(std::ofstream & log)
+  {
+    constexpr uint32_t operations = 200000, samplePeriod = 1000;
+    constexpr double compacted = 0.05; // Near enough all one free block
+    uint32_t const pageVertices = static_cast<uint32_t>(ChunkBufferPageBytes / sizeof(Vertex));
+
+    std::vector<uint32_t> meshSizes;
+    {
+      std::vector<std::unique_ptr<ChunkVolume>> volumes = surfaceVolumes();
+      SurfaceExtractor extractor(nullptr, nullptr, nullptr, nullptr, nullptr, nullptr);
+      std::vector<Vertex> vertices;
+      std::vector<uint32_t> indices;
+      for (auto const & volume : volumes)
+      {
+        if (extractor.buildMesh(*volume, vertices, indices)) meshSizes.push_back(static_cast<uint32_t>(vertices.size()));
+      }
+    }
+    if (meshSizes.empty()) return false;
+
+    log << "fill,allocP50Ns,allocP99Ns,allocMaxNs,freeMeanNs,failures,fragmentationMean,fragmentationMax,compactionMoves,fragmentationAfter" << std::endl;
+    for (double const fill : { 0.5, 0.75, 0.9 })
+    {
+      TlsfAllocator heap(pageVertices);
+      std::mt19937 rng(4422);
+      std::vector<uint32_t> live;
+      std::vector<uint64_t> allocNs;
+      uint64_t freeNs = 0, frees = 0, failures = 0;
+      double fragmentationSum = 0.0, fragmentationMax = 0.0;
+      uint32_t samples = 0;
+
+      for (uint32_t op = 0; op < operations; op++)
+      {
+        bool const spawn = live.empty() || heap.getStats().usedUnits < fill * pageVertices;
+        if (spawn)
+        {
+          // Sizes of real meshes, jittered so no two are quite the same
+          uint32_t size = meshSizes[rng() % meshSizes.size()];
+          size = std::max(size / 2 + static_cast<uint32_t>(rng() % size), 1u);
+          tp start = hr_clock::now();
+          uint32_t handle = heap.allocate(size, op);
+          allocNs.push_back(duration_cast<nanoseconds>(hr_clock::now() - start).count());
+          if (handle == TlsfAllocator::InvalidHandle)
+          {
+            failures++;
+          }
+          else
+          {
+            live.push_back(handle);
+          }
+        }
+        if (!spawn || rng() % 4 == 0)
+        {
+          size_t index = rng() % live.size();
+          tp start = hr_clock::now();
+          heap.free(live[index]);
+          freeNs += duration_cast<nanoseconds>(hr_clock::now() - start).count();
+          frees++;
+          live[index] = live.back();
+          live.pop_back();
+        }
+
+        if (op % samplePeriod == 0)
+        {
+          double fragmentation = heap.fragmentation();
+          fragmentationSum += fragmentation;
+          fragmentationMax = std::max(fragmentationMax, fragmentation);
+          samples++;
+        }
+      }
+
+      // A frame's worth of moves at a time until there's nothing left worth moving, moved blocks are freed straight away
+      uint32_t moves = 0;
+      for (uint32_t frame = 0; frame < 10000 && heap.fragmentation() > compacted; frame++)
+      {
+        std::vector<TlsfMove> planned = heap.planCompaction(ChunkBufferMovesPerFrame);
+        if (planned.empty()) break;
+        for (auto const & move : planned)
+        {
+          heap.setKey(move.to, move.key);
+          heap.free(move.from);
+          std::replace(live.begin(), live.end(), move.from, move.to);
+        }
+        moves += static_cast<uint32_t>(planned.size());
+      }
+
+      std::sort(allocNs.begin(), allocNs.end());
+      double const fragmentationMean = fragmentationSum / samples;
+      uint64_t const freeMeanNs = frees > 0 ? freeNs / frees : 0;
+      log << fill << "," << percentile(allocNs, 0.5) << "," << percentile(allocNs, 0.99) << "," << allocNs.back() << "," << freeMeanNs << "," << failures << ","
+        << fragmentationMean << "," << fragmentationMax << "," << moves << "," << heap.fragmentation() << std::endl;
+      syncout() << 100.0 * fill << "% full: allocate p50 " << percentile(allocNs, 0.5) << "ns, p99 " << percentile(allocNs, 0.99) << "ns, max " << allocNs.back()
+        << "ns, free " << freeMeanNs << "ns, " << failures << " failed, fragmentation mean " << fragmentationMean << " max " << fragmentationMax
+        << ", " << moves << " moves to compact to " << heap.fragmentation() << std::endl;
+    }
+    return true;
+  }
+
+  // Not a timing run, checks TlsfAllocator under random allocate, free and planCompaction
+  // against live ranges tracked on the side: no two live blocks may overlap, blocks keep the
+  // offset and size they were given, moves only go downwards into space nobody else has,
+  // validate() has to pass throughout and freeing everything has to leave one free block
+  // covering the whole capacity. Stops at the first failure
+  bool checkHeap(std::ofstream & log)
+  {
+    constexpr uint32_t capacity = 1 << 20, operations = 200000, validatePeriod = 64, compactionPeriod = 2000;
+
+    struct LiveRange
+    {
+      uint32_t offset, size, key;
+    };
+    std::unordered_map<uint32_t, LiveRange> live; // By handle
+    std::vector<uint32_t> handles;
+    uint32_t op = 0;
+    uint64_t allocated = 0, failures = 0, frees = 0, moves = 0, calledOff = 0, validations = 0;
+
+    auto fail = [&](char const * what) {
+      log << "failed," << op << "," << what << std::endl;
+      syncout() << "Heap check failed after " << op << " operations: " << what << std::endl;
+      return false;
+    };
+    auto overlapFree = [&]() {
+      std::vector<LiveRange> ranges;
+      ranges.reserve(live.size());
+      for (auto const & range : live) ranges.push_back(range.second);
+      std::sort(ranges.begin(), ranges.end(), [](auto const & lhs, auto const & rhs) { return lhs.offset < rhs.offset; });
+      for (size_t i = 0; i < ranges.size(); i++)
+      {
+        uint64_t const end = uint64_t(ranges[i].offset) + ranges[i].size;
+        if (end > capacity || (i + 1 < ranges.size() && end > ranges[i + 1].offset)) return false;
+      }
+      return true;
+    };
+    auto matches = [&](TlsfAllocator const & heap) {
+      for (auto const & range : live)
+      {
+        if (heap.offset(range.first) != range.second.offset || heap.size(range.first) != range.second.size || heap.key(range.first) != range.second.key) return false;
+      }
+      return true;
+    };
+
+    TlsfAllocator heap(capacity);
+    if (!heap.validate()) return fail("new heap");
+    if (heap.allocate(0) != TlsfAllocator::InvalidHandle) return fail("zero sized allocation");
+    if (heap.allocate(capacity + 1) != TlsfAllocator::InvalidHandle) return fail("allocation bigger than the heap");
+    uint32_t const whole = heap.allocate(capacity);
+    if (whole == TlsfAllocator::InvalidHandle || heap.offset(whole) != 0 || heap.getStats().freeBlocks != 0) return fail("allocating the whole heap");
+    heap.free(whole);
+    if (!heap.validate()) return fail("freeing the whole heap");
+
+    std::mt19937 rng(4422);
+    double fill = 0.5;
+    for (op = 0; op < operations; op++)
+    {
+      if (op % 10000 == 0) fill = 0.3 + 0.65 * (rng() % 100) / 100.0; // Wander between mostly empty and nearly full
+
+      bool const spawn = handles.empty() || heap.getStats().usedUnits < fill * capacity;
+      if (spawn)
+      {
+        // Mostly mesh sized, some tiny ones for the first row of lists, the odd huge one
+        uint32_t const kind = rng() % 16;
+        uint32_t const size = kind == 0 ? 1 + rng() % 16 : kind == 1 ? 1 + rng() % (capacity / 8) : 256 + rng() % 8192;
+        uint32_t const handle = heap.allocate(size, op);
+        if (handle == TlsfAllocator::InvalidHandle)
+        {
+          failures++;
+        }
+        else
+        {
+          if (live.count(handle) != 0) return fail("handle given out twice");
+          live[handle] = { heap.offset(handle), size, op };
+          handles.push_back(handle);
+          allocated++;
+          if (heap.size(handle) != size) return fail("allocation of the wrong size");
+        }
+      }
+      if (!spawn || rng() % 4 == 0)
+      {
+        size_t const index = rng() % handles.size();
+        heap.free(handles[index]);
+        live.erase(handles[index]);
+        handles[index] = handles.back();
+        handles.pop_back();
+        frees++;
+      }
+
+      if (op % compactionPeriod == 0)
+      {
+        std::vector<TlsfMove> planned = heap.planCompaction(1 + rng() % 16);
+        for (auto const & move : planned)
+        {
+          auto from = live.find(move.from);
+          if (from == live.end() || from->second.key != move.key || from->second.offset != move.fromOffset || from->second.size != move.size) return fail("move of a block that isn't live");
+          if (move.toOffset >= move.fromOffset || heap.offset(move.to) != move.toOffset || heap.size(move.to) != move.size || heap.key(move.to) != TlsfAllocator::NoKey) return fail("bad move destination");
+          if (live.count(move.to) != 0) return fail("move destination already live");
+          live[move.to] = { move.toOffset, move.size, TlsfAllocator::NoKey };
+        }
+        if (!overlapFree()) return fail("move destination overlaps a live block");
+        if (!heap.validate()) return fail("validate after planning a compaction");
+
+        // Carry out most of them, call the rest off
+        for (auto const & move : planned)
+        {
+          if (rng() % 4 != 0)
+          {
+            heap.setKey(move.to, move.key);
+            live[move.to].key = move.key;
+            heap.free(move.from);
+            live.erase(move.from);
+            std::replace(handles.begin(), handles.end(), move.from, move.to);
+            moves++;
+          }
+          else
+          {
+            heap.free(move.to);
+            live.erase(move.to);
+            calledOff++;
+          }
+        }
+      }
+
+      if (op % validatePeriod == 0)
+      {
+        validations++;
+        if (!heap.validate()) return fail("validate");
+        if (!overlapFree()) return fail("live blocks overlap");
+        if (!matches(heap)) return fail("live block changed underneath us");
+        TlsfStats const stats = heap.getStats();
+        if (stats.allocations != live.size() || stats.usedUnits + stats.freeUnits != capacity) return fail("stats don't add up");
+      }
+    }
+
+    for (uint32_t const handle : handles)
+    {
+      heap.free(handle);
+    }
+    live.clear();
+    TlsfStats const stats = heap.getStats();
+    if (!heap.validate()) return fail("validate after freeing everything");
+    if (stats.allocations != 0 || stats.usedUnits != 0 || stats.freeBlocks != 1 || stats.largestFreeUnits != capacity || heap.fragmentation() != 0.0)
+    {
+      return fail("freeing everything didn't leave one block of the whole capacity");
+    }
+
+    log << "result,operations,allocations,failures,frees,compactionMoves,movesCalledOff,validations" << std::endl;
+    log << "passed," << operations << "," << allocated << "," << failures << "," << frees << "," << moves << "," << calledOff << "," << validations << std::endl;
+    syncout() << "Heap check passed: " << operations << " operations, " << allocated << " allocations (" << failures << " failed), " << frees << " frees, "
+      << moves << " compaction moves (" << calledOff << " called off), " << validations << " validations" << std::endl;
+    return true;
+  }
+
+  // Building a frame's indirect draw commands from the render list, for as many chunks as
+  // are drawn now and well past it, with meshes spread over one page or interleaved across
+  // several. This is all the CPU does per chunk now the draws themselves are one
+  // vkCmdDrawIndexedIndirect per page, so it should stay at a few ns per chunk
+  bool benchDraws(std::ofstream & log)
+  {
+    constexpr uint32_t frames = 2000;
+
+    // Stand-ins for page buffers, only compared, never used
+    auto fakeBuffer = [](uint64_t const id) {
+      VkBuffer buffer = VK_NULL_HANDLE;
+      std::memcpy(&buffer, &id, sizeof(buffer));
+      return buffer;
+    };
+
+    log << "chunks,pages,batches,buildP50Ns,buildP99Ns,nsPerChunk" << std::endl;
+    for (uint32_t const chunks : { 64u, 256u, 1024u, 4096u })
+    {
+      for (uint32_t const pages : { 1u, 4u })
+      {
+        std::mt19937 rng(4422);
+        std::vector<ModelData> models;
+        uint32_t vertexOffset = 0, indexOffset = 0;
+        for (uint32_t i = 0; i < chunks; i++)
+        {
+          uint32_t const page = rng() % pages;
+          uint32_t const vertexCount = 1000 + rng() % 4000;
+          uint32_t const indexCount = vertexCount * 3 / 2;
+          models.push_back({ fakeBuffer(2 * page + 1), fakeBuffer(2 * page + 2), nullptr, indexCount
+            , { page, i, vertexOffset, vertexCount }
+            , { page, i, indexOffset, indexCount } });
+          vertexOffset += vertexCount;
+          indexOffset += indexCount;
+        }
+
+        IndirectDrawList drawList;
+        std::vector<uint64_t> buildNs;
+        buildNs.reserve(frames);
+        for (uint32_t frame = 0; frame < frames; frame++)
+        {
+          tp start = hr_clock::now();
+          drawList.clear();
+          for (uint32_t i = 0; i < chunks; i++)
+          {
+            drawList.add(models[i], i);
+          }
+          drawList.build();
+          buildNs.push_back(duration_cast<nanoseconds>(hr_clock::now() - start).count());
+        }
+        if (drawList.getCommands().size() != chunks) return false;
+
+        std::sort(buildNs.begin(), buildNs.end());
+        uint64_t const p50 = percentile(buildNs, 0.5);
+        uint64_t const p99 = percentile(buildNs, 0.99);
+        double const nsPerChunk = static_cast<double>(p50) / chunks;
+        size_t const batches = drawList.getBatches().size();
+        log << chunks << "," << pages << "," << batches << "," << p50 << "," << p99 << "," << nsPerChunk << std::endl;
+        syncout() << chunks << " chunks over " << pages << " page(s): " << batches << " indirect draw(s), build p50 " << p50
+          << "ns, p99 " << p99 << "ns, " << nsPerChunk << "ns per chunk" << std::endl;
+      }
+    }
+    return true;
+  }
+
+  struct Benchmark
+  {
+    char const * name;
+    bool(*run)(std::ofstream & log);
+  };
+
+  Benchmark const benchmarks[] = {
+    { "cache", benchCache },
+    { "cachemoves", checkCacheMoves },
+    { "map", benchMap },
+    { "mesh", benchMesh },
+    { "executor", benchExecutor },
+    { "topology", benchTopology },
+    { "heap", benchHeap },
+    { "heapcheck", checkHeap },
+    { "draws", benchDraws }
+  };
+}
+
+bool RunBenchmark(std::string const & name)
+{
+  bool found = false, succeeded = true;
+  for (auto const & benchmark : benchmarks)
+  {
+    if (name != "all" && name != benchmark.name) continue;
+    found = true;
+
+    std::ofstream log = createLogFile(std::string("Bench_") + benchmark.name);
+    if (!log.is_open())
+    {
+      return false;
+    }
+    syncout() << "Running " << benchmark.name << " benchmark" << std::endl;
+    succeeded = benchmark.run(log) && succeeded;
+    log.close();
+  }
+
+  if (!found)
+  {
+    syncout() << "Unknown benchmark " << name << std::endl;
+  }
+  return found && succeeded;
+}
@@ -0,0 +1,9 @@
+#pragma once
+#include <string>
+
+// Headless microbenchmarks, run with -bench <name> or -bench all. Each benchmark
+// writes its results to ComputeApp_Bench_<name>_<time>.log as well as the console.
+// No window or device needed. -bench heapcheck and -bench cachemoves aren't timed, they
+// check TlsfAllocator's bookkeeping under random use and that chunk data goes through
+// the cache without copies or allocations, and fail the run if anything's off
+bool RunBenchmark(std::string const & name);
@@ -0,0 +1,269 @@
+#pragma once
+#include <list>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+
+// Eviction policies for ChunkCache. A policy only tracks keys, the cache owns
+// the stored values. Every policy provides the same interface:
+//   insert(key)       - key has just been added to the cache
+//   touch(key)        - key already in the cache has been hit
+//   erase(key)        - key has been evicted
+//   victim(incoming)  - key to evict to make room for incoming, which is not yet inserted
+//   victim()          - key to evict when nothing is coming in, e.g. the budget shrank
+//   clear()
+
+// Least recently used, evicts whichever entry has gone longest without a hit
+template<class Key>
+class LRUPolicy
+{
+public:
+  static constexpr char const * name = "LRU";
+
+  void insert(Key const & key)
+  {
+    order.push_front(key);
+    positions[key] = order.begin();
+  }
+
+  void touch(Key const & key)
+  {
+    order.splice(order.begin(), order, positions.at(key));
+  }
+
+  void erase(Key const & key)
+  {
+    auto it = positions.find(key);
+    if (it != positions.end())
+    {
+      order.erase(it->second);
+      positions.erase(it);
+    }
+  }
+
+  Key victim(Key const & /*incoming*/) const
+  {
+    return victim();
+  }
+
+  Key victim() const
+  {
+    return order.back();
+  }
+
+  void clear()
+  {
+    order.clear();
+    positions.clear();
+  }
+
+private:
+  std::list<Key> order; // Most recently used at the front
+  std::unordered_map<Key, typename std::list<Key>::iterator> positions;
+};
+
+// CLOCK (second chance), approximates LRU with a single reference bit per
+// entry so hits don't have to reorder anything
+template<class Key>
+class ClockPolicy
+{
+public:
+  static constexpr char const * name = "CLOCK";
+
+  void insert(Key const & key)
+  {
+    uint32_t slot;
+    if (!freeSlots.empty())
+    {
+      slot = freeSlots.back();
+      freeSlots.pop_back();
+      ring[slot] = { key, false, true };
+    }
+    else
+    {
+      slot = static_cast<uint32_t>(ring.size());
+      ring.push_back({ key, false, true });
+    }
+    slots[key] = slot;
+  }
+
+  void touch(Key const & key)
+  {
+    ring[slots.at(key)].referenced = true;
+  }
+
+  void erase(Key const & key)
+  {
+    auto it = slots.find(key);
+    if (it != slots.end())
+    {
+      ring[it->second].occupied = false;
+      freeSlots.push_back(it->second);
+      slots.erase(it);
+    }
+  }
+
+  Key victim(Key const & /*incoming*/)
+  {
+    return victim();
+  }
+
+  Key victim()
+  {
+    // Sweep the hand round, clearing reference bits until we find an entry without one
+    for (;;)
+    {
+      Entry & entry = ring[hand];
+      if (entry.occupied)
+      {
+        if (!entry.referenced)
+        {
+          return entry.key;
+        }
+        entry.referenced = false;
+      }
+      hand = (hand + 1) % ring.size();
+    }
+  }
+
+  void clear()
+  {
+    ring.clear();
+    slots.clear();
+    freeSlots.clear();
+    hand = 0;
+  }
+
+private:
+  struct Entry
+  {
+    Key key;
+    bool referenced;
+    bool occupied;
+  };
+  std::vector<Entry> ring;
+  std::unordered_map<Key, uint32_t> slots;
+  std::vector<uint32_t> freeSlots;
+  size_t hand = 0;
+};
+
+// Adaptive Replacement Cache (Megiddo & Modha, 2003). Splits entries seen once
+// (t1) from entries seen at least twice (t2) and keeps ghost lists of recently
+// evicted keys (b1, b2) to adapt the balance between the two. The original
+// algorithm assumes a fixed entry count, here the resident entry count stands
+// in for it so the policy also works under a byte budget
+template<class Key>
+class ARCPolicy
+{
+public:
+  static constexpr char const * name = "ARC";
+
+  void insert(Key const & key)
+  {
+    size_t c = std::max<size_t>(t1.size() + t2.size(), 1);
+    auto it = lists.find(key);
+    if (it != lists.end() && it->second.list == &b1)
+    {
+      // Recently evicted from t1, favour recency
+      p = std::min(c, p + std::max<size_t>(b2.size() / std::max<size_t>(b1.size(), 1), 1));
+      move(it->second, t2);
+    }
+    else if (it != lists.end() && it->second.list == &b2)
+    {
+      // Recently evicted from t2, favour frequency
+      size_t delta = std::max<size_t>(b1.size() / std::max<size_t>(b2.size(), 1), 1);
+      p = (p > delta) ? p - delta : 0;
+      move(it->second, t2);
+    }
+    else
+    {
+      t1.push_front(key);
+      lists[key] = { &t1, t1.begin() };
+    }
+  }
+
+  void touch(Key const & key)
+  {
+    move(lists.at(key), t2);
+  }
+
+  void erase(Key const & key)
+  {
+    auto it = lists.find(key);
+    if (it == lists.end()) return;
+
+    // Evicted entries are remembered in the matching ghost list
+    if (it->second.list == &t1)
+    {
+      move(it->second, b1);
+    }
+    else if (it->second.list == &t2)
+    {
+      move(it->second, b2);
+    }
+    trimGhosts();
+  }
+
+  Key victim(Key const & incoming) const
+  {
+    auto it = lists.find(incoming);
+    return chooseVictim(it != lists.end() && it->second.list == &b2);
+  }
+
+  Key victim() const
+  {
+    return chooseVictim(false);
+  }
+
+  void clear()
+  {
+    t1.clear(); t2.clear(); b1.clear(); b2.clear();
+    lists.clear();
+    p = 0;
+  }
+
+private:
+  // incomingInB2 breaks the tie in favour of evicting from t1, as in REPLACE
+  Key chooseVictim(bool const incomingInB2) const
+  {
+    if (!t1.empty() && (t2.empty() || t1.size() > p || (incomingInB2 && t1.size() == p)))
+    {
+      return t1.back();
+    }
+    else
+    {
+      return t2.back();
+    }
+  }
+
+  using List = std::list<Key>;
+  struct Location
+  {
+    List * list;
+    typename List::iterator it;
+  };
+
+  void move(Location & location, List & to)
+  {
+    to.splice(to.begin(), *location.list, location.it);
+    location = { &to, to.begin() };
+  }
+
+  void trimGhosts()
+  {
+    size_t c = t1.size() + t2.size();
+    for (List * ghost : { &b1, &b2 })
+    {
+      while (ghost->size() > c && !ghost->empty())
+      {
+        lists.erase(ghost->back());
+        ghost->pop_back();
+      }
+    }
+  }
+
+  List t1, t2, b1, b2; // Most recent at the front of each
+  std::unordered_map<Key, Location> lists;
+  size_t p = 0; // Target size of t1
+};
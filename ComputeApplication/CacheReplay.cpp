@@ -0,0 +1,148 @@
+#include "CacheReplay.hpp"
+#include "CameraPath.hpp"
+#include "ChunkCache.hpp"
+#include "ChunkCoord.hpp"
+#include "ChunkManager.hpp"
+#include "coordinatewrap.hpp"
+#include "metrics.hpp"
+#include <unordered_map>
+
+namespace
+{
+  glm::vec3 closestChunkPos(glm::vec3 const pos)
+  {
+    return {
+      static_cast<float>(static_cast<double>(pos.x) - std::fmod(static_cast<double>(pos.x), static_cast<double>(TechnicalChunkDim))),
+      static_cast<float>(static_cast<double>(pos.y) - std::fmod(static_cast<double>(pos.y), static_cast<double>(TechnicalChunkDim))),
+      static_cast<float>(static_cast<double>(pos.z) - std::fmod(static_cast<double>(pos.z), static_cast<double>(TechnicalChunkDim)))
+    };
+  }
+
+  // Contents don't matter, only which keys survive, but entries need a
+  // realistic size for the byte budget to mean anything
+  ChunkCacheData placeholderEntry()
+  {
+    ChunkCacheData data;
+    data.volume.runs.resize(1024);
+    data.mesh.vertexData.resize(16 * 1024);
+    return data;
+  }
+
+  // A chunk which was hit comes back bigger than it left, e.g. it was meshed while loaded,
+  // to a cache which has to evict to fit it. Under ARC the sequence leaves t1 at its target
+  // size and the returning key alone in t2, where victim looks first. The chunk coming back
+  // has to stay, and only the chunk it displaces counts as an eviction
+  template<class Policy>
+  bool replayReturnOverBudget()
+  {
+    auto entry = [](bool const meshed) {
+      ChunkCacheData data;
+      data.volume.runs.resize(1024);
+      if (meshed) data.mesh.vertexData.resize(512 * sizeof(VoxelRun));
+      return data;
+    };
+    size_t const entryCost = cacheEntryCost(entry(false));
+    BasicChunkCache<Policy> cache(3 * entryCost);
+
+    for (KeyType const key : { 1, 2, 3, 4, 1 }) // 4 evicts 1, the second 1 evicts 2 and comes back from ARC's b1
+    {
+      cache.add(key, entry(false));
+    }
+    cache.setBudget(2 * entryCost); // Evicts 3 under ARC
+
+    // Other policies keep other keys, take the first one left, under ARC that's 1
+    KeyType key = 1;
+    while (key <= 4 && !cache.has(key)) key++;
+    ChunkCacheData data;
+    if (!cache.retrieve(key, data)) return false;
+
+    uint64_t const evictions = cache.getStats().evictions;
+    data = entry(true);
+    cache.add(key, std::move(data));
+    return cache.has(key) && cache.bytes() <= cache.getBudget() && cache.getStats().evictions == evictions + 1;
+  }
+
+  template<class Policy>
+  ChunkCacheStats replay(std::vector<CameraPathSample> const & path, size_t const budgetBytes)
+  {
+    BasicChunkCache<Policy> cache(budgetBytes);
+    std::unordered_map<KeyType, glm::vec3> loaded;
+    std::vector<ChunkCoord> const spawnOffsets = sphereOffsets(static_cast<int32_t>(chunkSpawnDistance));
+
+    for (auto const & sample : path)
+    {
+      glm::vec3 centre = closestChunkPos(sample.pos);
+
+      // Chunks leave as soon as they cross the despawn radius, like ChunkManager::despawnChunks
+      for (auto it = loaded.begin(); it != loaded.end();)
+      {
+        if (sqrdToroidalDistance(centre, it->second) > chunkDespawnRadius * chunkDespawnRadius)
+        {
+          cache.add(it->first, placeholderEntry());
+          it = loaded.erase(it);
+        }
+        else
+        {
+          ++it;
+        }
+      }
+
+      // Same spawn sphere as ChunkManager::getChunkSpawnList, a full sweep gives
+      // the same result as its incremental scan
+      ChunkCoord centreCoord = chunkCoordFromWorld(sample.pos);
+      for (auto const & offset : spawnOffsets)
+      {
+        ChunkCoord coord = wrapChunkCoord(centreCoord + offset);
+        glm::vec3 chunkPos = chunkWorldPos(coord);
+        KeyType key = chunkKey(coord);
+        if (loaded.count(key) == 0)
+        {
+          ChunkCacheData data;
+          cache.retrieve(key, data); // Counts the hit or miss
+          loaded[key] = chunkPos;
+        }
+      }
+    }
+
+    return cache.getStats();
+  }
+
+  template<class Policy>
+  bool replayAndLog(std::vector<CameraPathSample> const & path, size_t const budgetBytes, std::ofstream & logFile)
+  {
+    ChunkCacheStats stats = replay<Policy>(path, budgetBytes);
+    uint64_t lookups = stats.hits + stats.misses;
+    double hitRate = lookups > 0 ? static_cast<double>(stats.hits) / static_cast<double>(lookups) : 0.0;
+    bool const returnKept = replayReturnOverBudget<Policy>();
+
+    synclog(logFile) << Policy::name << "," << stats.hits << "," << stats.misses << "," << stats.evictions << "," << hitRate << "," << returnKept << std::endl;
+    syncout() << Policy::name << ": " << stats.hits << " hits, " << stats.misses << " misses, " << stats.evictions << " evictions, hit rate " << hitRate
+      << (returnKept ? "" : ", FAILED to keep a chunk returned over budget") << std::endl;
+    return returnKept;
+  }
+}
+
+bool ReplayCameraPathThroughCachePolicies(std::string const & cameraPathFile, size_t const budgetBytes)
+{
+  std::vector<CameraPathSample> path;
+  if (!LoadCameraPath(cameraPathFile, path))
+  {
+    syncout() << "Failed to load camera path " << cameraPathFile << std::endl;
+    return false;
+  }
+
+  std::ofstream logFile = createLogFile("CacheReplay");
+  if (!logFile.is_open())
+  {
+    return false;
+  }
+  logFile << "policy,hits,misses,evictions,hitRate,returnOverBudgetKept" << std::endl;
+
+  syncout() << "Replaying " << path.size() << " samples with a " << budgetBytes / (1024 * 1024) << "MB cache budget" << std::endl;
+  bool passed = replayAndLog<LRUPolicy<KeyType>>(path, budgetBytes, logFile);
+  passed = replayAndLog<ClockPolicy<KeyType>>(path, budgetBytes, logFile) && passed;
+  passed = replayAndLog<ARCPolicy<KeyType>>(path, budgetBytes, logFile) && passed;
+
+  logFile.close();
+  return passed;
+}
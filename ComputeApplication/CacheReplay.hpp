@@ -0,0 +1,12 @@
+#pragma once
+#include <string>
+#include <cstddef>
+
+// Replays a camera path recorded with -recordCameraPath through ChunkCache once
+// per eviction policy (see CachePolicies.hpp), mimicking ChunkManager's spawn and
+// despawn rules, and writes hit/miss/eviction counts for each policy to
+// ComputeApp_CacheReplay_<time>.log. Runs headless, no window or device needed.
+// Each policy gets a cache of budgetBytes, as set by -cacheBudgetMB. Each policy also
+// runs a fixed case returning a retrieved chunk to a cache over budget, false if the
+// cache dropped it
+bool ReplayCameraPathThroughCachePolicies(std::string const & cameraPathFile, size_t const budgetBytes);
@@ -0,0 +1,43 @@
+#include "CameraPath.hpp"
+#include "coordinatewrap.hpp"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+bool LoadCameraPath(std::string const & filename, std::vector<CameraPathSample> & path)
+{
+  std::ifstream file(filename);
+  if (!file.is_open())
+  {
+    return false;
+  }
+
+  std::string line;
+  std::getline(file, line); // Skip headings
+  while (std::getline(file, line))
+  {
+    std::istringstream entry(line);
+    CameraPathSample sample;
+    char comma;
+    if (entry >> sample.time >> comma >> sample.pos.x >> comma >> sample.pos.y >> comma >> sample.pos.z)
+    {
+      path.push_back(sample);
+    }
+  }
+
+  return !path.empty();
+}
+
+glm::vec3 SampleCameraPath(std::vector<CameraPathSample> const & path, double const time)
+{
+  auto next = std::upper_bound(path.begin(), path.end(), time,
+    [](double const t, CameraPathSample const & sample) { return t < sample.time; });
+  if (next == path.begin()) return path.front().pos;
+  if (next == path.end()) return path.back().pos;
+
+  auto prev = next - 1;
+  float t = static_cast<float>((time - prev->time) / (next->time - prev->time));
+  glm::vec3 pos = prev->pos + toroidalDelta(prev->pos, next->pos) * t;
+  WrapCoordinates(pos);
+  return pos;
+}
@@ -0,0 +1,17 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+// Camera paths are recorded with -recordCameraPath as "time,x,y,z" lines
+struct CameraPathSample
+{
+  double time;
+  glm::vec3 pos;
+};
+
+bool LoadCameraPath(std::string const & filename, std::vector<CameraPathSample> & path);
+
+// Position along the path at the given time, interpolated the short way round the
+// torus and clamped to the ends of the path
+glm::vec3 SampleCameraPath(std::vector<CameraPathSample> const & path, double const time);
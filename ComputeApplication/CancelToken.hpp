@@ -0,0 +1,27 @@
+#pragma once
+#include <atomic>
+#include <memory>
+
+// Cooperative cancellation for chunk jobs. Copies share the same flag, the chunk
+// keeps one and the job carries another, so the chunk manager can cancel work it
+// no longer needs and the job notices at its next checkpoint between stages
+class CancelToken
+{
+public:
+  CancelToken()
+    : state(std::make_shared<std::atomic<bool>>(false))
+  {}
+
+  void cancel()
+  {
+    state->store(true, std::memory_order_relaxed);
+  }
+
+  bool cancelled() const
+  {
+    return state->load(std::memory_order_relaxed);
+  }
+
+private:
+  std::shared_ptr<std::atomic<bool>> state;
+};
@@ -0,0 +1,234 @@
+#include "ChunkBufferPool.hpp"
+#include "VulkanInterface.hpp"
+#include "VulkanInterface.Functions.hpp"
+#include "Vertex.hpp"
+#include "metrics.hpp"
+#include <algorithm>
+#include <cassert>
+
+ChunkBufferPool::ChunkBufferPool(VkDevice * const logicalDevice, VmaAllocator * const allocator, VkDeviceSize const pageBytes)
+  : logicalDevice(logicalDevice)
+  , allocator(allocator)
+  , pageBytes(pageBytes)
+{
+}
+
+ChunkBufferPool::~ChunkBufferPool()
+{
+  assert(retired.empty() && pages.empty());
+}
+
+VkDeviceSize ChunkBufferPool::elementSize(ChunkBufferUsage const usage)
+{
+  return usage == ChunkBufferUsage::Vertex ? sizeof(Vertex) : sizeof(uint32_t);
+}
+
+bool ChunkBufferPool::acquire(ChunkBufferUsage const usage, uint32_t const count, uint32_t const key, VkBuffer & buffer, ChunkBufferRange & range)
+{
+  std::lock_guard<std::mutex> lock(poolMutex);
+  if (count == 0 || count > pageBytes / elementSize(usage))
+  {
+    stats.allocationFailures++; // Bigger than a whole page
+    return false;
+  }
+
+  // A new page always has room, so this ends on the page it adds at the latest
+  tp start = hr_clock::now();
+  for (size_t index = 0; index <= pages.size(); index++)
+  {
+    if (index == pages.size())
+    {
+      // Every page is full, or too fragmented for this one
+      stats.allocateNs += duration_cast<nanoseconds>(hr_clock::now() - start).count();
+      if (!addPage(usage))
+      {
+        stats.allocationFailures++;
+        return false;
+      }
+      start = hr_clock::now();
+    }
+
+    Page & page = *pages[index];
+    if (page.usage != usage) continue;
+    uint32_t block = page.heap.allocate(count, key);
+    if (block == TlsfAllocator::InvalidHandle) continue;
+
+    buffer = page.buffer;
+    range = { static_cast<uint32_t>(index), block, page.heap.offset(block), count };
+    stats.allocations++;
+    stats.allocateNs += duration_cast<nanoseconds>(hr_clock::now() - start).count();
+    return true;
+  }
+  return false;
+}
+
+bool ChunkBufferPool::addPage(ChunkBufferUsage const usage)
+{
+  auto page = std::make_unique<Page>(usage, static_cast<uint32_t>(pageBytes / elementSize(usage)));
+
+  // Source as well as destination so defragmentation can copy within a page
+  VkBufferUsageFlags usageFlags = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT
+    | ((usage == ChunkBufferUsage::Vertex) ? VK_BUFFER_USAGE_VERTEX_BUFFER_BIT : VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+  if (!VulkanInterface::CreateBuffer(*allocator
+    , pageBytes
+    , usageFlags
+    , page->buffer
+    , VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT
+    , VMA_MEMORY_USAGE_GPU_ONLY
+    , VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+    , VK_NULL_HANDLE
+    , page->allocation))
+  {
+    return false;
+  }
+
+  pages.push_back(std::move(page));
+  stats.pages++;
+  stats.pageBytes += pageBytes;
+  return true;
+}
+
+void ChunkBufferPool::retire(ModelData const & model)
+{
+  std::lock_guard<std::mutex> lock(poolMutex);
+  retireRange(model.vertices, framesSubmitted);
+  retireRange(model.indices, framesSubmitted);
+}
+
+void ChunkBufferPool::retireRange(ChunkBufferRange const & range, uint64_t const frame)
+{
+  if (range.page == InvalidChunkBufferPage) return; // Chunk never had a mesh uploaded
+
+  Page & page = *pages[range.page];
+  page.heap.setKey(range.block, TlsfAllocator::NoKey); // Nobody's chunk any more, never moved
+  retired.push_back({ range, frame });
+  stats.pendingRetirements++;
+  stats.pendingBytes += range.count * elementSize(page.usage);
+}
+
+void ChunkBufferPool::frameSubmitted(uint32_t const frameSlot)
+{
+  std::lock_guard<std::mutex> lock(poolMutex);
+  if (slotFrames.size() <= frameSlot)
+  {
+    slotFrames.resize(frameSlot + 1, 0);
+  }
+  slotFrames[frameSlot] = ++framesSubmitted;
+}
+
+void ChunkBufferPool::collect(std::vector<VkFence> const & frameFences)
+{
+  std::lock_guard<std::mutex> lock(poolMutex);
+
+  // Frames finish in submission order, the newest signalled fence covers everything before it
+  for (size_t slot = 0; slot < slotFrames.size() && slot < frameFences.size(); slot++)
+  {
+    if (slotFrames[slot] > framesCompleted && VulkanInterface::IsFenceSignalled(*logicalDevice, frameFences[slot]))
+    {
+      framesCompleted = slotFrames[slot];
+    }
+  }
+
+  size_t kept = 0;
+  for (auto & entry : retired)
+  {
+    if (entry.frame <= framesCompleted)
+    {
+      release(entry.range);
+    }
+    else
+    {
+      retired[kept++] = entry;
+    }
+  }
+  retired.resize(kept);
+}
+
+void ChunkBufferPool::collectAll()
+{
+  std::lock_guard<std::mutex> lock(poolMutex);
+  for (auto & entry : retired)
+  {
+    release(entry.range);
+  }
+  retired.clear();
+  framesCompleted = framesSubmitted;
+}
+
+void ChunkBufferPool::destroyAll()
+{
+  std::lock_guard<std::mutex> lock(poolMutex);
+  retired.clear();
+  stats.pendingRetirements = 0;
+  stats.pendingBytes = 0;
+
+  // Anything still allocated goes with its page
+  for (auto & page : pages)
+  {
+    vmaDestroyBuffer(*allocator, page->buffer, page->allocation);
+  }
+  pages.clear();
+  stats.pages = 0;
+  stats.pageBytes = 0;
+}
+
+std::vector<ChunkBufferMove> ChunkBufferPool::planMoves(uint32_t const maxMoves, double const threshold)
+{
+  std::lock_guard<std::mutex> lock(poolMutex);
+  std::vector<ChunkBufferMove> moves;
+  for (size_t index = 0; index < pages.size() && moves.size() < maxMoves; index++)
+  {
+    Page & page = *pages[index];
+    if (page.heap.fragmentation() <= threshold) continue;
+
+    uint32_t const pageIndex = static_cast<uint32_t>(index);
+    for (auto const & planned : page.heap.planCompaction(maxMoves - static_cast<uint32_t>(moves.size())))
+    {
+      moves.push_back({ page.usage
+        , planned.key
+        , page.buffer
+        , { pageIndex, planned.from, planned.fromOffset, planned.size }
+        , { pageIndex, planned.to, planned.toOffset, planned.size } });
+    }
+  }
+  return moves;
+}
+
+void ChunkBufferPool::commitMove(ChunkBufferMove const & move)
+{
+  std::lock_guard<std::mutex> lock(poolMutex);
+  pages[move.to.page]->heap.setKey(move.to.block, move.key);
+  // The frame doing the copy hasn't been submitted yet, it's the one which has to finish
+  retireRange(move.from, framesSubmitted + 1);
+  stats.moves++;
+}
+
+void ChunkBufferPool::cancelMove(ChunkBufferMove const & move)
+{
+  std::lock_guard<std::mutex> lock(poolMutex);
+  pages[move.to.page]->heap.free(move.to.block);
+}
+
+ChunkBufferStats ChunkBufferPool::getStats()
+{
+  std::lock_guard<std::mutex> lock(poolMutex);
+  ChunkBufferStats current = stats;
+  current.usedBytes = 0;
+  current.largestFreeBytes = 0;
+  for (auto const & page : pages)
+  {
+    TlsfStats heapStats = page->heap.getStats();
+    VkDeviceSize const size = elementSize(page->usage);
+    current.usedBytes += heapStats.usedUnits * size;
+    current.largestFreeBytes = std::max<uint64_t>(current.largestFreeBytes, heapStats.largestFreeUnits * size);
+  }
+  return current;
+}
+
+void ChunkBufferPool::release(ChunkBufferRange const & range)
+{
+  Page & page = *pages[range.page];
+  stats.pendingRetirements--;
+  stats.pendingBytes -= range.count * elementSize(page.usage);
+  page.heap.free(range.block);
+}
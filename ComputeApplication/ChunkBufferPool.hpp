@@ -0,0 +1,120 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "vk_mem_alloc.h"
+#include "components.hpp"
+#include "TlsfAllocator.hpp"
+
+enum class ChunkBufferUsage
+{
+  Vertex,
+  Index
+};
+
+struct ChunkBufferStats
+{
+  uint64_t pendingRetirements; // Waiting on a frame fence
+  uint64_t pendingBytes;
+  uint64_t pages;
+  uint64_t pageBytes;          // Device memory held by every page
+  uint64_t usedBytes;          // Including ranges waiting to retire
+  uint64_t largestFreeBytes;   // Largest free range in any one page, the biggest mesh that fits without a new page
+  uint64_t allocations;        // Cumulative
+  uint64_t allocationFailures; // Too big for a page, or a new page couldn't be created
+  uint64_t allocateNs;         // Cumulative time spent suballocating, not counting new pages
+  uint64_t moves;              // Ranges moved by defragmentation
+};
+
+// One chunk's range which planMoves wants moved lower in its page
+struct ChunkBufferMove
+{
+  ChunkBufferUsage usage;
+  uint32_t key;
+  VkBuffer buffer; // The page, from and to are both in it
+  ChunkBufferRange from, to;
+};
+
+// Heap of chunk mesh data. Vertices and indices are suballocated from a few large
+// device-local buffers, pages, each with a TlsfAllocator counting in vertices or indices,
+// so a chunk costs no VMA calls and every chunk in a page draws from the same buffers.
+// Ranges are tagged with the last frame submitted when they're retired, the frame in
+// flight which might still draw them, and only go back to their page's allocator once
+// that frame's drawingFinishedFence has signalled. Ranges are keyed by their chunk so
+// defragmentation can say which chunks' meshes to move. Thread safe
+class ChunkBufferPool
+{
+public:
+  ChunkBufferPool(VkDevice * const logicalDevice, VmaAllocator * const allocator, VkDeviceSize const pageBytes);
+  ~ChunkBufferPool();
+
+  ChunkBufferPool(ChunkBufferPool const &) = delete;
+  ChunkBufferPool & operator=(ChunkBufferPool const &) = delete;
+
+  // count elements for key, from the first page with room, adding a page if none has.
+  // buffer is the page, range.offset is where in it in elements
+  bool acquire(ChunkBufferUsage const usage, uint32_t const count, uint32_t const key, VkBuffer & buffer, ChunkBufferRange & range);
+
+  // The model's ranges may still be in use by frames in flight
+  void retire(ModelData const & model);
+
+  // Call after submitting a frame which used the given frame resources slot
+  void frameSubmitted(uint32_t const frameSlot);
+  // Polls each slot's fence without waiting, anything retired before a finished frame is freed
+  void collect(std::vector<VkFence> const & frameFences);
+  // Device must be idle, everything retired is freed straight away
+  void collectAll();
+  // Device must be idle
+  void destroyAll();
+
+  // Up to maxMoves ranges from pages more fragmented than threshold (see TlsfAllocator::fragmentation),
+  // each with a range reserved lower in the same page. The caller copies the ones whose chunks it
+  // owns and commits them, and cancels the rest
+  std::vector<ChunkBufferMove> planMoves(uint32_t const maxMoves, double const threshold);
+  // The copy must be recorded into the next frame submitted, from is retired behind it
+  void commitMove(ChunkBufferMove const & move);
+  void cancelMove(ChunkBufferMove const & move);
+
+  ChunkBufferStats getStats();
+
+  static VkDeviceSize elementSize(ChunkBufferUsage const usage);
+
+private:
+  struct Page
+  {
+    Page(ChunkBufferUsage const usage, uint32_t const capacity)
+      : usage(usage)
+      , heap(capacity)
+    {}
+
+    ChunkBufferUsage usage;
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VmaAllocation allocation = VK_NULL_HANDLE;
+    TlsfAllocator heap;
+  };
+
+  struct RetiredRange
+  {
+    ChunkBufferRange range;
+    uint64_t frame; // Serial of the last frame which may use it
+  };
+
+  void retireRange(ChunkBufferRange const & range, uint64_t const frame);
+  void release(ChunkBufferRange const & range);
+  bool addPage(ChunkBufferUsage const usage);
+
+  VkDevice * const logicalDevice;
+  VmaAllocator * const allocator;
+  VkDeviceSize const pageBytes;
+
+  std::mutex poolMutex;
+  std::vector<std::unique_ptr<Page>> pages; // Indexed by ChunkBufferRange::page, never shrinks until destroyAll
+  std::vector<RetiredRange> retired;
+
+  uint64_t framesSubmitted = 0;
+  uint64_t framesCompleted = 0;
+  std::vector<uint64_t> slotFrames; // Serial of the frame last submitted with each slot's fence
+
+  ChunkBufferStats stats = {};
+};
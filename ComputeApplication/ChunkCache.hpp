@@ -1,47 +1,353 @@
 #pragma once
-#include "cpp-cache\fifo-cache.h"
 #include "ReservedMap.hpp"
+#include "CachePolicies.hpp"
+#include "VolumeCodec.hpp"
+#include "MeshCodec.hpp"
+#include "ChunkCoord.hpp"
+#include <array>
+#include <mutex>
 
-using KeyType = uint64_t;
 using EntityHandle = uint32_t;
-using ChunkCacheData = std::array<Voxel, ChunkSize>;
 
-class ChunkCache
+// Everything kept for an unloaded chunk. The mesh lets a revisit skip straight to
+// upload, the volume is kept for anything which needs the voxels back
+struct ChunkCacheData
+{
+  CompressedVolume volume;
+  CompressedMesh mesh;
+  bool prefetched = false; // Generated ahead of the camera rather than unloaded
+  bool taken = false;      // Cache side only, the data is out with a loaded chunk and this keeps its place
+
+  // Move-only, chunk data passes between the chunk and the cache without being copied
+  ChunkCacheData() = default;
+  ChunkCacheData(ChunkCacheData &&) = default;
+  ChunkCacheData & operator=(ChunkCacheData &&) = default;
+  ChunkCacheData(ChunkCacheData const &) = delete;
+  ChunkCacheData & operator=(ChunkCacheData const &) = delete;
+
+  bool empty() const
+  {
+    return volume.empty() && !mesh.built;
+  }
+};
+
+struct ChunkCacheStats
+{
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t evictions;
+  uint64_t insertions;
+  uint64_t prefetchUsed;   // Prefetched entries which were hit
+  uint64_t prefetchWasted; // Prefetched entries evicted or replaced without ever being hit
+};
+
+// Bytes an entry is charged against the cache budget, roughly what it costs in RAM
+inline size_t cacheEntryCost(ChunkCacheData const & data)
+{
+  constexpr size_t storageOverhead = sizeof(KeyType) + 2 * sizeof(void*); // Map node and bucket
+  return storageOverhead + data.volume.bytes() + data.mesh.bytes();
+}
+
+// Chunks might get unloaded but we might need them again if the player backtracks,
+// so we keep recently unloaded chunks compressed data for quick reloading.
+// Entries are variable sized so the cache is limited by a byte budget rather than
+// an entry count, which entries survive is decided by the Policy (see CachePolicies.hpp).
+// Not thread safe, see ShardedChunkCache
+template<class Policy, uint32_t ReserveEntries = ChunkCacheReserveEntries>
+class BasicChunkCache : protected ReservedMap<KeyType, ChunkCacheData, ReserveEntries>
 {
 public:
-  bool has(KeyType const key)
+  BasicChunkCache(size_t const budgetBytes = ChunkCacheBudgetBytes)
+    : stats{}
+    , entries(0)
+    , takenEntries(0)
+    , bytesUsed(0)
+    , budget(budgetBytes)
   {
-    return cache.has(key);
   }
 
-  void add(KeyType const key, ChunkCacheData & data)
+  // Doesn't count towards the stats, retrieve() counts the lookup
+  bool has(KeyType const key) const
   {
-    cache.insert(key, std::move(data));
+    return this->contained_in_storage(key) && !this->get_from_storage(key).taken;
   }
 
+  // For lookups which has() already answered, so never reach retrieve()
+  void recordMiss()
+  {
+    stats.misses++;
+  }
+
+  void add(KeyType const key, ChunkCacheData && data)
+  {
+    size_t cost = cacheEntryCost(data);
+    if (cost > budget) return; // Would never fit
+
+    if (this->contained_in_storage(key))
+    {
+      // Either a taken entry coming back from its chunk or a replacement. Make room before
+      // touching the key, touched it's where ARC looks first once t1 is down to its target,
+      // and the data coming in would be the victim. If the key goes anyway it's only lost its
+      // place, and the data comes in below as a new key
+      size_t const existingCost = cacheEntryCost(this->get_from_storage(key));
+      while (this->contained_in_storage(key) && bytesUsed - existingCost + cost > budget)
+      {
+        evict(policy.victim(key));
+      }
+    }
+
+    if (this->contained_in_storage(key))
+    {
+      ChunkCacheData const & existing = this->get_from_storage(key);
+      if (existing.prefetched) stats.prefetchWasted++;
+      if (existing.taken) takenEntries--;
+      bytesUsed -= cacheEntryCost(existing);
+      this->insert_into_storage(key, std::move(data));
+      bytesUsed += cost;
+      policy.touch(key);
+      return;
+    }
+
+    evictUntilWithinBudget(key, cost);
+
+    this->insert_into_storage(key, std::move(data));
+    policy.insert(key);
+    entries++;
+    bytesUsed += cost;
+    stats.insertions++;
+  }
+
+  // Moves the data out to the chunk, which moves it back in when it unloads again.
+  // The key stays behind as a taken entry, charged only its storage overhead, and the
+  // policy records the hit, so when the data comes back it's promoted rather than
+  // looking like a new key. The entry is emptied in place, so a hit doesn't allocate
   bool retrieve(KeyType const key, ChunkCacheData & data)
   {
-    if (cache.try_get(key, data))
+    if (has(key))
     {
-      cache.erase(key);
+      ChunkCacheData & stored = this->get_from_storage(key);
+      bytesUsed -= cacheEntryCost(stored);
+      data = std::move(stored);
+      stored = ChunkCacheData();
+      stored.taken = true;
+      bytesUsed += cacheEntryCost(stored);
+      takenEntries++;
+      policy.touch(key);
+      stats.hits++;
+      if (data.prefetched) stats.prefetchUsed++;
       return true;
     }
     else
     {
+      stats.misses++;
       return false;
     }
   }
 
+  // Can be changed at runtime, shrinking evicts straight away
+  void setBudget(size_t const budgetBytes)
+  {
+    budget = budgetBytes;
+    evictUntilWithinBudget();
+  }
+
   void clear()
   {
-    cache.clear();
+    this->clear_storage();
+    policy.clear();
+    entries = 0;
+    takenEntries = 0;
+    bytesUsed = 0;
+  }
+
+  // Entries holding data, taken entries are with their chunks
+  size_t size() const
+  {
+    return entries - takenEntries;
+  }
+
+  size_t bytes() const
+  {
+    return bytesUsed;
+  }
+
+  size_t getBudget() const
+  {
+    return budget;
+  }
+
+  ChunkCacheStats const & getStats() const
+  {
+    return stats;
   }
 
 protected:
-  // Chunks might get unloaded but we might need it again if the player backtracks,
-  // So we use a fifo cache to store the last few unloaded chunks volume data for quick reloading
-  cpp_cache::fifo_cache< KeyType
-                       , ChunkCacheData
-                       , ChunkMapCacheSize
-                       , ReservedMap<KeyType, ChunkCacheData, ChunkMapCacheSize> > cache; 
-};
\ No newline at end of file
+  // Makes room for an incoming entry of the given cost
+  void evictUntilWithinBudget(KeyType const incoming, size_t const incomingCost)
+  {
+    while (entries > 0 && bytesUsed + incomingCost > budget)
+    {
+      evict(policy.victim(incoming));
+    }
+  }
+
+  // Nothing coming in, e.g. the budget shrank. Every key is valid, so there's no
+  // placeholder key which could stand in for an incoming one
+  void evictUntilWithinBudget()
+  {
+    while (entries > 0 && bytesUsed > budget)
+    {
+      evict(policy.victim());
+    }
+  }
+
+  // A taken entry only loses its place, the chunk's data comes back in as a new key
+  void evict(KeyType const key)
+  {
+    ChunkCacheData const & victim = this->get_from_storage(key);
+    if (victim.taken)
+    {
+      takenEntries--;
+    }
+    else
+    {
+      if (victim.prefetched) stats.prefetchWasted++;
+      stats.evictions++;
+    }
+    bytesUsed -= cacheEntryCost(victim);
+    policy.erase(key);
+    this->erase_from_storage(key);
+    entries--;
+  }
+
+  Policy policy;
+  ChunkCacheStats stats;
+  size_t entries; // Including taken entries
+  size_t takenEntries;
+  size_t bytesUsed;
+  size_t budget;
+};
+
+// Lock striped cache so generation and meshing workers can probe and fill it in
+// parallel without going through the registry lock. Each shard is a BasicChunkCache
+// with its own lock, policy and an equal share of the budget, so eviction is per shard
+template<class Policy, uint32_t ShardCount>
+class ShardedChunkCache
+{
+public:
+  ShardedChunkCache(size_t const budgetBytes = ChunkCacheBudgetBytes)
+  {
+    setBudget(budgetBytes);
+  }
+
+  bool has(KeyType const key)
+  {
+    Shard & shard = shardFor(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.cache.has(key);
+  }
+
+  void recordMiss(KeyType const key)
+  {
+    Shard & shard = shardFor(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.cache.recordMiss();
+  }
+
+  void add(KeyType const key, ChunkCacheData && data)
+  {
+    Shard & shard = shardFor(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.cache.add(key, std::move(data));
+  }
+
+  bool retrieve(KeyType const key, ChunkCacheData & data)
+  {
+    Shard & shard = shardFor(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.cache.retrieve(key, data);
+  }
+
+  void setBudget(size_t const budgetBytes)
+  {
+    for (auto & shard : shards)
+    {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      shard.cache.setBudget(budgetBytes / ShardCount);
+    }
+  }
+
+  void clear()
+  {
+    for (auto & shard : shards)
+    {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      shard.cache.clear();
+    }
+  }
+
+  size_t size()
+  {
+    return sum([](auto const & cache) { return cache.size(); });
+  }
+
+  size_t bytes()
+  {
+    return sum([](auto const & cache) { return cache.bytes(); });
+  }
+
+  size_t getBudget()
+  {
+    return sum([](auto const & cache) { return cache.getBudget(); });
+  }
+
+  ChunkCacheStats getStats()
+  {
+    ChunkCacheStats total = {};
+    for (auto & shard : shards)
+    {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      ChunkCacheStats const & stats = shard.cache.getStats();
+      total.hits += stats.hits;
+      total.misses += stats.misses;
+      total.evictions += stats.evictions;
+      total.insertions += stats.insertions;
+      total.prefetchUsed += stats.prefetchUsed;
+      total.prefetchWasted += stats.prefetchWasted;
+    }
+    return total;
+  }
+
+private:
+  struct alignas(64) Shard // Own cache line so neighbouring locks don't false share
+  {
+    std::mutex mutex;
+    BasicChunkCache<Policy, ChunkCacheReserveEntries / ShardCount> cache;
+  };
+
+  // Chunk keys pack x, y and z into separate bit ranges, mix them so
+  // neighbouring chunks are spread across shards
+  Shard & shardFor(KeyType key)
+  {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdull;
+    key ^= key >> 33;
+    return shards[key % ShardCount];
+  }
+
+  template<class Getter>
+  size_t sum(Getter getter)
+  {
+    size_t total = 0;
+    for (auto & shard : shards)
+    {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      total += getter(shard.cache);
+    }
+    return total;
+  }
+
+  std::array<Shard, ShardCount> shards;
+};
+
+using ChunkCache = ShardedChunkCache<ARCPolicy<KeyType>, ChunkCacheShards>;
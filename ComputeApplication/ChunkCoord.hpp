@@ -0,0 +1,101 @@
+#pragma once
+#include "common.hpp"
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+using KeyType = uint64_t;
+
+// Integer chunk coordinates, chunk (x,y,z) has its origin at (x,y,z) * TechnicalChunkDim
+// in world space. x and z wrap at WorldDimension like the world does, y doesn't wrap
+struct ChunkCoord
+{
+  int32_t x, y, z;
+
+  bool operator==(ChunkCoord const & rhs) const { return x == rhs.x && y == rhs.y && z == rhs.z; }
+  bool operator!=(ChunkCoord const & rhs) const { return !(*this == rhs); }
+  ChunkCoord operator+(ChunkCoord const & rhs) const { return { x + rhs.x, y + rhs.y, z + rhs.z }; }
+  ChunkCoord operator-(ChunkCoord const & rhs) const { return { x - rhs.x, y - rhs.y, z - rhs.z }; }
+
+  int32_t lengthSqrd() const { return x * x + y * y + z * z; }
+};
+
+// Unique key for a chunk, used by the cache and anything else which needs to hash chunks.
+// Each axis gets its own bit range, y gets 32 bits so chunks below zero have keys too
+inline KeyType chunkKey(ChunkCoord const coord)
+{
+  return (static_cast<KeyType>(static_cast<uint32_t>(coord.y)) << 32)
+       | (static_cast<KeyType>(static_cast<uint16_t>(coord.z)) << 16)
+       |  static_cast<KeyType>(static_cast<uint16_t>(coord.x));
+}
+
+inline int32_t wrapChunkAxis(int32_t const v)
+{
+  constexpr int32_t dim = static_cast<int32_t>(WorldDimension);
+  int32_t wrapped = v % dim;
+  return (wrapped < 0) ? wrapped + dim : wrapped;
+}
+
+inline ChunkCoord wrapChunkCoord(ChunkCoord const coord)
+{
+  return { wrapChunkAxis(coord.x), coord.y, wrapChunkAxis(coord.z) };
+}
+
+// Chunk containing the given world position, rounds down for negative positions too
+inline ChunkCoord chunkCoordFromWorld(glm::vec3 const pos)
+{
+  return wrapChunkCoord({
+    static_cast<int32_t>(std::floor(pos.x * invTechnicalChunkDim)),
+    static_cast<int32_t>(std::floor(pos.y * invTechnicalChunkDim)),
+    static_cast<int32_t>(std::floor(pos.z * invTechnicalChunkDim))
+  });
+}
+
+inline glm::vec3 chunkWorldPos(ChunkCoord const coord)
+{
+  return {
+    static_cast<float>(coord.x * static_cast<int32_t>(TechnicalChunkDim)),
+    static_cast<float>(coord.y * static_cast<int32_t>(TechnicalChunkDim)),
+    static_cast<float>(coord.z * static_cast<int32_t>(TechnicalChunkDim))
+  };
+}
+
+// Shortest offset from one chunk to another, wrapping on x and z
+inline ChunkCoord toroidalChunkDelta(ChunkCoord const from, ChunkCoord const to)
+{
+  constexpr int32_t dim = static_cast<int32_t>(WorldDimension);
+  ChunkCoord delta = to - from;
+  if      (delta.x >  dim / 2) delta.x -= dim;
+  else if (delta.x < -dim / 2) delta.x += dim;
+  if      (delta.z >  dim / 2) delta.z -= dim;
+  else if (delta.z < -dim / 2) delta.z += dim;
+  return delta;
+}
+
+// Every offset strictly inside a sphere of the given radius (in chunks), closest first.
+// Matches the spawn rule of a chunk origin being within chunkSpawnRadius of the player's chunk origin
+inline std::vector<ChunkCoord> sphereOffsets(int32_t const radius)
+{
+  std::vector<ChunkCoord> offsets;
+  for (int32_t z = -radius; z <= radius; z++)
+  {
+    for (int32_t y = -radius; y <= radius; y++)
+    {
+      for (int32_t x = -radius; x <= radius; x++)
+      {
+        ChunkCoord offset = { x, y, z };
+        if (offset.lengthSqrd() < radius * radius)
+        {
+          offsets.push_back(offset);
+        }
+      }
+    }
+  }
+
+  std::stable_sort(offsets.begin(), offsets.end(), [](ChunkCoord const & lhs, ChunkCoord const & rhs) {
+    return lhs.lengthSqrd() < rhs.lengthSqrd();
+  });
+  return offsets;
+}
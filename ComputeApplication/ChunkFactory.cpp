@@ -3,14 +3,14 @@
 uint32_t ChunkFactory::CreateChunkEntity(glm::vec3 pos, float dimX, float dimY, float dimZ)
 {
   assert(allocator != nullptr);
+  assert(volumePool != nullptr);
 
   registryMutex->lock();
   auto entity = registry->create();
   registry->assign<WorldPosition>(entity, pos);
-  registry->assign<VolumeData>(entity, std::array<Voxel, ChunkSize>({ 0 }), false);
-  registry->assign<ModelData>(entity, VkBuffer(), VkBuffer(), VmaAllocation(), VmaAllocation(), allocator, 0ui32);
   registry->assign<AABB>(entity, dimX, dimY, dimZ);
   registry->assign<Flags>(entity, false, 0ui32);
+  chunks->create(entity, pos, allocator);
   registryMutex->unlock();
 
   return entity;
@@ -18,9 +18,11 @@ uint32_t ChunkFactory::CreateChunkEntity(glm::vec3 pos, float dimX, float dimY,
 
 void ChunkFactory::DestroyChunk(uint32_t entityHandle)
 {
-  auto[volume, model] = registry->get<VolumeData, ModelData>(entityHandle);
-  model.destroy();
+  ChunkRecord & chunk = chunks->get(entityHandle);
+  chunkBuffers->retire(chunk.model);
+  volumePool->release(chunk.volume.volume);
 
+  chunks->destroy(entityHandle);
   registry->destroy(entityHandle);
 }
 
@@ -28,13 +30,16 @@ void ChunkFactory::DestroyAllChunks()
 {
   registryMutex->lock();
   syncout() << "Destroy All Chunks!" << std::endl;
-  registry->view<WorldPosition, VolumeData, ModelData, AABB>().each(
+  registry->view<WorldPosition, AABB>().each(
     [&](const uint32_t entity, auto&&...)
     {
-      auto[volume, model] = registry->get<VolumeData, ModelData>(entity);
-      model.destroy();
+      ChunkRecord & chunk = chunks->get(entity);
+      chunkBuffers->retire(chunk.model);
+      volumePool->release(chunk.volume.volume);
+      chunks->destroy(entity);
       registry->destroy(entity);
     }
   );
+  chunkBuffers->collectAll();
   registryMutex->unlock();
 }
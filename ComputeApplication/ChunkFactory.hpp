@@ -1,14 +1,21 @@
 #pragma once
 #include <entt\entity\registry.hpp>
 #include "components.hpp"
+#include "VolumePool.hpp"
+#include "ChunkBufferPool.hpp"
+#include "ChunkTable.hpp"
+#include "InstrumentedMutex.hpp"
 
 class ChunkFactory
 {
 public:
-  ChunkFactory(entt::DefaultRegistry * const registry, std::mutex * const registryMutex, VmaAllocator * const allocator)
+  ChunkFactory(entt::DefaultRegistry * const registry, InstrumentedMutex * const registryMutex, VmaAllocator * const allocator, VolumePool * const volumePool, ChunkBufferPool * const chunkBuffers, ChunkTable * const chunks)
     : registry(registry)
     , registryMutex(registryMutex)
     , allocator(allocator)
+    , volumePool(volumePool)
+    , chunkBuffers(chunkBuffers)
+    , chunks(chunks)
   {
   }
 
@@ -17,12 +24,19 @@ public:
     assert(registry->size() == 0);
   }
 
+  // Gives the chunk an entity and a Queued ChunkRecord
   uint32_t CreateChunkEntity(glm::vec3 pos, float dimX, float dimY, float dimZ);
+  // Chunk must be Retiring, registry lock must be held. The chunk's mesh may
+  // still be in use by frames in flight, its ranges are retired to the ChunkBufferPool
   void DestroyChunk(uint32_t entityHandle);
+  // No jobs may be running and the device must be idle, ranges go straight back to their pages
   void DestroyAllChunks();
 
 protected:
   entt::DefaultRegistry * const registry;
-  std::mutex * const registryMutex;
+  InstrumentedMutex * const registryMutex;
   VmaAllocator * const allocator;
+  VolumePool * const volumePool;
+  ChunkBufferPool * const chunkBuffers;
+  ChunkTable * const chunks;
 };
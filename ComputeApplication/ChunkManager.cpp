@@ -4,15 +4,59 @@
 #include "vk_mem_alloc.h"
 #include "coordinatewrap.hpp"
 #include "syncout.hpp"
+#include <algorithm>
+#include <cstdlib>
 
-ChunkManager::ChunkManager(entt::DefaultRegistry * const registry, std::mutex * const registryMutex, VmaAllocator * const allocator, VkDevice * const logicalDevice)
-  : factory(registry, registryMutex, allocator)
+ChunkManager::ChunkManager(entt::DefaultRegistry * const registry, InstrumentedMutex * const registryMutex, VmaAllocator * const allocator, VkDevice * const logicalDevice, VolumePool * const volumePool, ChunkBufferPool * const chunkBuffers, ColumnOccupancy const * const occupancy, ChunkTable * const chunks)
+  : factory(registry, registryMutex, allocator, volumePool, chunkBuffers, chunks)
   , registry(registry)
   , registryMutex(registryMutex)
+  , chunks(chunks)
   , logicalDevice(logicalDevice)
   , allocator(allocator)
+  , volumePool(volumePool)
+  , occupancy(occupancy)
+  , spawnOffsets(sphereOffsets(static_cast<int32_t>(chunkSpawnDistance)))
+  , lastSpawnCentre{ 0, 0, 0 }
+  , lastDespawnCentre{ 0, 0, 0 }
 {
+  for (auto const & offset : sphereOffsets(static_cast<int32_t>(chunkSpawnDistance * 2)))
+  {
+    if (offset.lengthSqrd() <= despawnRadiusSqrd)
+    {
+      despawnOffsets.push_back(offset);
+    }
+  }
+
+  for (int32_t dz = -1; dz <= 1; dz++)
+  {
+    for (int32_t dy = -1; dy <= 1; dy++)
+    {
+      for (int32_t dx = -1; dx <= 1; dx++)
+      {
+        ChunkCoord delta = { dx, dy, dz };
+        auto & shell = spawnShells[spawnShellIndex(delta)];
+        for (auto const & offset : spawnOffsets)
+        {
+          // Relative to the previous centre this chunk was at offset + delta
+          if ((offset + delta).lengthSqrd() >= spawnRadiusSqrd)
+          {
+            shell.push_back(offset);
+          }
+        }
 
+        // Offsets from the previous centre which were kept but are beyond the radius after the move
+        auto & despawnShell = despawnShells[spawnShellIndex(delta)];
+        for (auto const & offset : despawnOffsets)
+        {
+          if ((offset - delta).lengthSqrd() > despawnRadiusSqrd)
+          {
+            despawnShell.push_back(offset);
+          }
+        }
+      }
+    }
+  }
 }
 
 ChunkManager::~ChunkManager()
@@ -22,151 +66,343 @@ ChunkManager::~ChunkManager()
 
 std::vector<std::pair<EntityHandle, ChunkManager::ChunkStatus>> ChunkManager::getChunkSpawnList(glm::vec3 const playerPos)
 {
-  // Find the closest chunk from which to base our search off using double precision
-  glm::vec3 offsetPlayerPos = {
-        static_cast<float>(static_cast<double>(playerPos.x) - std::fmod(static_cast<double>(playerPos.x), static_cast<double>(TechnicalChunkDim))),
-        static_cast<float>(static_cast<double>(playerPos.y) - std::fmod(static_cast<double>(playerPos.y), static_cast<double>(TechnicalChunkDim))),
-        static_cast<float>(static_cast<double>(playerPos.z) - std::fmod(static_cast<double>(playerPos.z), static_cast<double>(TechnicalChunkDim)))
-  };
-
-  //uint32_t chunkRadius = TechnicalChunkDim * std::ceilf(chunkSpawnRadius * invTechnicalChunkDim);
-  constexpr uint32_t chunkRadius = static_cast<uint32_t>(chunkSpawnRadius);// (TechnicalChunkDim * chunkSpawnDistance) / 2;
-  constexpr float chunkRadiusf = static_cast<float>(chunkRadius);
   std::vector<std::pair<EntityHandle, ChunkManager::ChunkStatus>> chunkList;
 
-  for (float z = offsetPlayerPos.z - chunkRadiusf; z < offsetPlayerPos.z + chunkRadiusf; z += static_cast<float>(TechnicalChunkDim))
+  ChunkCoord centre = chunkCoordFromWorld(playerPos);
+  if (!spawnCentreValid || centre != lastSpawnCentre)
   {
-    for (float y = offsetPlayerPos.y - chunkRadiusf; y < offsetPlayerPos.y + chunkRadiusf; y += static_cast<float>(TechnicalChunkDim))
+    // Moving a single chunk only brings the leading shell into range,
+    // anything bigger (teleports, very low frame rates) gets a full sweep
+    std::vector<ChunkCoord> const * offsets = &spawnOffsets;
+    ChunkCoord delta = toroidalChunkDelta(lastSpawnCentre, centre);
+    if (spawnCentreValid && std::abs(delta.x) <= 1 && std::abs(delta.y) <= 1 && std::abs(delta.z) <= 1)
+    {
+      offsets = &spawnShells[spawnShellIndex(delta)];
+    }
+    else
+    {
+      spawnBacklog.clear(); // The sweep finds everything still waiting
+    }
+    lastSpawnCentre = centre;
+    spawnCentreValid = true;
+
+    for (auto const & offset : *offsets)
     {
-      for (float x = offsetPlayerPos.x - chunkRadiusf; x < offsetPlayerPos.x + chunkRadiusf; x += static_cast<float>(TechnicalChunkDim))
+      ChunkCoord coord = wrapChunkCoord(centre + offset);
+      if (!map.isChunkLoaded(coord))
       {
-        glm::vec3 chunkPos = { x,y,z };
-        WrapCoordinates(chunkPos);
-        KeyType key = chunkKey(chunkPos);
-        if (pointInSpawnRange(offsetPlayerPos, chunkPos))
-        {
-          ChunkStatus status = chunkStatus(key);
-          if (status == ChunkStatus::NotLoadedNotCached || status == ChunkStatus::NotLoadedCached)
-          {
-            EntityHandle handle = factory.CreateChunkEntity(chunkPos, TechnicalChunkDim, TechnicalChunkDim, TechnicalChunkDim);
-            map.loadChunk(key, handle);
-            chunkList.push_back(std::make_pair(handle, status));
-          }
-          // else status == ChunkStatus::Loaded, requires no action
-        }
+        spawnBacklog.push_back(coord);
       }
     }
+
+    // Whatever was left over from earlier moves competes with the new shell, closest first
+    std::stable_sort(spawnBacklog.begin(), spawnBacklog.end(), [centre](ChunkCoord const & lhs, ChunkCoord const & rhs) {
+      return toroidalChunkDelta(centre, lhs).lengthSqrd() < toroidalChunkDelta(centre, rhs).lengthSqrd();
+    });
   }
 
+  FrameBudget budget(MaxChunkSpawnsPerUpdate, ChunkSpawnBudgetUs);
+  size_t next = 0;
+  for (; next < spawnBacklog.size() && !budget.exhausted(); next++)
+  {
+    ChunkCoord coord = spawnBacklog[next];
+    // Left range while it waited, if the player turns back it's in that move's shell again
+    if (toroidalChunkDelta(centre, coord).lengthSqrd() >= spawnRadiusSqrd) continue;
+
+    ChunkStatus status = chunkStatus(coord);
+    if (status == ChunkStatus::NotLoadedNotCached && !occupancy->mayHaveSurface(coord))
+    {
+      // Entirely above or below anywhere the surface can be, nothing to build
+      map.loadChunk(coord, ChunkMap::KnownEmpty);
+      knownEmptyChunks++;
+    }
+    else if (status == ChunkStatus::NotLoadedNotCached || status == ChunkStatus::NotLoadedCached)
+    {
+      if (status == ChunkStatus::NotLoadedNotCached)
+      {
+        cache.recordMiss(chunkKey(coord)); // Generated, never looked up again
+      }
+      EntityHandle handle = factory.CreateChunkEntity(chunkWorldPos(coord), TechnicalChunkDim, TechnicalChunkDim, TechnicalChunkDim);
+      map.loadChunk(coord, handle);
+      chunkList.push_back(std::make_pair(handle, status));
+      chunksSpawned++;
+      budget.spend();
+    }
+    // else status == ChunkStatus::Loaded, requires no action
+  }
+  spawnBacklog.erase(spawnBacklog.begin(), spawnBacklog.begin() + next);
+
   return chunkList;
 }
 
-bool ChunkManager::getChunkVolumeDataFromCache(KeyType const key, ChunkCacheData & data)
+size_t ChunkManager::spawnShellIndex(ChunkCoord const delta)
+{
+  return static_cast<size_t>((delta.x + 1) + 3 * (delta.y + 1) + 9 * (delta.z + 1));
+}
+
+bool ChunkManager::getChunkDataFromCache(KeyType const key, ChunkCacheData & data)
 {
   return cache.retrieve(key, data);
 }
 
-void ChunkManager::despawnChunks(glm::vec3 const playerPos)
+ChunkCacheStats ChunkManager::getCacheStats()
 {
-  // Find the closest chunk from which to base our search off using double precision
-  glm::vec3 offsetPlayerPos = {
-        static_cast<float>(static_cast<double>(playerPos.x) - std::fmod(static_cast<double>(playerPos.x), static_cast<double>(TechnicalChunkDim))),
-        static_cast<float>(static_cast<double>(playerPos.y) - std::fmod(static_cast<double>(playerPos.y), static_cast<double>(TechnicalChunkDim))),
-        static_cast<float>(static_cast<double>(playerPos.z) - std::fmod(static_cast<double>(playerPos.z), static_cast<double>(TechnicalChunkDim)))
-  };
+  return cache.getStats();
+}
 
-  auto view = registry->view<WorldPosition, VolumeData, ModelData, AABB>();
+size_t ChunkManager::getCacheSize()
+{
+  return cache.size();
+}
+
+size_t ChunkManager::getCacheBytes()
+{
+  return cache.bytes();
+}
+
+void ChunkManager::setCacheBudget(size_t const budgetBytes)
+{
+  cache.setBudget(budgetBytes);
+}
+
+void ChunkManager::despawnChunks(glm::vec3 const playerPos)
+{
+  reapCancelledChunks();
 
-  for (auto chunk : view)
-  { 
-    registryMutex->lock();
-    auto[worldPos, volume] = registry->get<WorldPosition, VolumeData>(chunk);
-    if (volume.generating)
+  ChunkCoord centre = chunkCoordFromWorld(playerPos);
+  if (!despawnCentreValid)
+  {
+    // Nothing can be loaded yet, chunks only spawn around the centre we're starting from
+    lastDespawnCentre = centre;
+    despawnCentreValid = true;
+  }
+  else if (centre != lastDespawnCentre)
+  {
+    // Everything loaded is within the despawn radius of the last centre or already in
+    // the backlog, so only chunks in the trailing shell of a single chunk move (or for
+    // bigger jumps, the old sphere) can have left it
+    ChunkCoord delta = toroidalChunkDelta(lastDespawnCentre, centre);
+    if (std::abs(delta.x) <= 1 && std::abs(delta.y) <= 1 && std::abs(delta.z) <= 1)
     {
-      registryMutex->unlock();
-      continue; // Wait until the volume has finished generating
+      for (auto const & offset : despawnShells[spawnShellIndex(delta)])
+      {
+        ChunkCoord coord = wrapChunkCoord(lastDespawnCentre + offset);
+        if (map.isChunkLoaded(coord)) despawnBacklog.push_back(coord);
+      }
     }
-    registryMutex->unlock();
-
-    if (pointInDespawnRange(offsetPlayerPos, worldPos.pos))
+    else
     {
-      KeyType key = chunkKey(worldPos.pos);
-      ChunkStatus status = chunkStatus(key);
-      if (status == ChunkStatus::Loaded)
+      for (auto const & offset : despawnOffsets)
       {
-        registryMutex->lock();
-        unloadChunk(key);
-        registryMutex->unlock();
+        ChunkCoord coord = wrapChunkCoord(lastDespawnCentre + offset);
+        if (map.isChunkLoaded(coord) && toroidalChunkDelta(centre, coord).lengthSqrd() > despawnRadiusSqrd)
+        {
+          despawnBacklog.push_back(coord);
+        }
       }
     }
+    lastDespawnCentre = centre;
   }
 
-}
+  if (despawnBacklog.empty()) return;
 
-void ChunkManager::loadChunk(KeyType const key, EntityHandle const handle)
-{
-  map.loadChunk(key, handle);
+  std::lock_guard<InstrumentedMutex> lock(*registryMutex);
+  FrameBudget budget(MaxChunkDespawnsPerUpdate, ChunkDespawnBudgetUs);
+  while (!despawnBacklog.empty() && !budget.exhausted())
+  {
+    ChunkCoord coord = despawnBacklog.back();
+    despawnBacklog.pop_back();
+    // Came back within the despawn radius while it waited, the gap between the spawn
+    // and despawn radii means it's kept rather than thrashing at the boundary
+    if (toroidalChunkDelta(centre, coord).lengthSqrd() <= despawnRadiusSqrd) continue;
+
+    if (despawnChunk(coord)) budget.spend();
+  }
 }
 
-void ChunkManager::unloadChunk(KeyType const key)
+bool ChunkManager::despawnChunk(ChunkCoord const coord)
 {
-  EntityHandle handle = map.unloadChunk(key);
-  syncout() << "Unload " << handle << "\n";
-  ChunkCacheData data;
-  VolumeData & volume = registry->get<VolumeData>(handle);
-  data = volume.volume;
-  cache.add(key, data);
-  factory.DestroyChunk(handle);
+  if (!map.isChunkLoaded(coord)) return false;
+
+  EntityHandle handle = map.get(coord);
+  if (handle == ChunkMap::KnownEmpty)
+  {
+    map.unloadChunk(coord);
+    return false;
+  }
+
+  if (retireChunk(handle))
+  {
+    unloadChunk(coord);
+  }
+  else
+  {
+    // A worker owns it, stop its job at the next checkpoint. The chunk comes out of the
+    // map now so it respawns fresh if the player comes back, the entity goes once the job lets go
+    chunks->get(handle).cancel.cancel();
+    map.unloadChunk(coord);
+    cancelledChunks.push_back(handle);
+  }
+  return true;
 }
 
-void ChunkManager::clear()
+bool ChunkManager::retireChunk(EntityHandle const handle)
 {
-  map.clear();
-  factory.DestroyAllChunks();
-  cache.clear();
+  return chunks->transition(handle, ChunkLifecycle::Queued, ChunkLifecycle::Retiring)
+    || chunks->transition(handle, ChunkLifecycle::Resident, ChunkLifecycle::Retiring);
 }
 
-KeyType ChunkManager::chunkKey(glm::vec3 const pos)
+void ChunkManager::reapCancelledChunks()
 {
-  KeyType x = static_cast<KeyType>(pos.x)
-        , y = static_cast<KeyType>(pos.y)
-        , z = static_cast<KeyType>(pos.z);
+  if (cancelledChunks.empty()) return;
 
-  KeyType key = ((x & 0x1FFFFF) << 43) | ((y & 0x1FFFFF) << 22) | (z & 0x3FFFFF);
-
-  return key;
+  std::lock_guard<InstrumentedMutex> lock(*registryMutex);
+  auto it = cancelledChunks.begin();
+  while (it != cancelledChunks.end())
+  {
+    if (chunks->state(*it) == ChunkLifecycle::Free)
+    {
+      it = cancelledChunks.erase(it);
+    }
+    else if (retireChunk(*it))
+    {
+      // Whatever the job finished before it stopped is still worth caching
+      cacheAndDestroyChunk(*it, chunkKey(chunkCoordFromWorld(chunks->get(*it).pos)));
+      it = cancelledChunks.erase(it);
+    }
+    else
+    {
+      ++it;
+    }
+  }
 }
 
-ChunkManager::ChunkStatus ChunkManager::chunkStatus(uint64_t const key)
+std::vector<std::pair<KeyType, glm::vec3>> ChunkManager::getChunkPrefetchList(glm::vec3 const playerPos, glm::vec3 const predictedPos, uint32_t const maxChunks)
 {
-  if (map.isChunkLoaded(key))
+  std::vector<std::pair<KeyType, glm::vec3>> candidates;
+
+  std::lock_guard<std::mutex> lock(prefetchMutex);
+  if (maxChunks == 0) return candidates;
+
+  ChunkCoord predictedCentre = chunkCoordFromWorld(predictedPos);
+  for (auto const & offset : spawnOffsets)
   {
-    return ChunkStatus::Loaded;
+    ChunkCoord coord = wrapChunkCoord(predictedCentre + offset);
+    KeyType key = chunkKey(coord);
+    if (!map.isChunkLoaded(coord) && occupancy->mayHaveSurface(coord) && prefetchesInFlight.count(key) == 0 && !cache.has(key))
+    {
+      candidates.push_back(std::make_pair(key, chunkWorldPos(coord)));
+    }
   }
-  else if (cache.has(key))
+
+  // The closest chunks will cross the spawn radius first
+  auto closer = [&](auto const & lhs, auto const & rhs) {
+    return sqrdToroidalDistance(playerPos, lhs.second) < sqrdToroidalDistance(playerPos, rhs.second);
+  };
+  if (candidates.size() > maxChunks)
   {
-    return ChunkStatus::NotLoadedCached;
+    std::partial_sort(candidates.begin(), candidates.begin() + maxChunks, candidates.end(), closer);
+    candidates.resize(maxChunks);
   }
-  else
+
+  for (auto const & candidate : candidates)
   {
-    return ChunkStatus::NotLoadedNotCached;
+    prefetchesInFlight.insert(candidate.first);
   }
+  prefetchesIssued += candidates.size();
+
+  return candidates;
+}
+
+void ChunkManager::finishPrefetch(KeyType const key, ChunkCacheData && data)
+{
+  data.prefetched = true;
+  cache.add(key, std::move(data));
+  cancelPrefetch(key);
+}
+
+void ChunkManager::returnToCache(KeyType const key, ChunkCacheData && data)
+{
+  cache.add(key, std::move(data));
+}
+
+void ChunkManager::cancelPrefetch(KeyType const key)
+{
+  std::lock_guard<std::mutex> lock(prefetchMutex);
+  prefetchesInFlight.erase(key);
+}
+
+size_t ChunkManager::getPrefetchesInFlight()
+{
+  std::lock_guard<std::mutex> lock(prefetchMutex);
+  return prefetchesInFlight.size();
 }
 
-bool ChunkManager::pointInSpawnRange(glm::vec3 const playerPos, glm::vec3 const point)
+uint64_t ChunkManager::getPrefetchesIssued()
 {
-  float sqrdDist = sqrdToroidalDistance(playerPos, point);
+  std::lock_guard<std::mutex> lock(prefetchMutex);
+  return prefetchesIssued;
+}
 
-  bool result = sqrdDist < chunkSpawnRadius*chunkSpawnRadius;
-  
-  return result;
+void ChunkManager::loadChunk(ChunkCoord const coord, EntityHandle const handle)
+{
+  map.loadChunk(coord, handle);
 }
 
-bool ChunkManager::pointInDespawnRange(glm::vec3 const playerPos, glm::vec3 const point)
+void ChunkManager::unloadChunk(ChunkCoord const coord)
 {
-  float sqrdDist = sqrdToroidalDistance(playerPos, point);
+  EntityHandle handle = map.unloadChunk(coord);
+  syncout() << "Unload " << handle << "\n";
+  cacheAndDestroyChunk(handle, chunkKey(coord));
+}
+
+void ChunkManager::cacheAndDestroyChunk(EntityHandle const handle, KeyType const key)
+{
+  ChunkRecord & chunk = chunks->get(handle);
+  auto & volume = chunk.volume;
+  chunk.cancel.cancel(); // Any job still queued for it can be dropped
+  ChunkCacheData data;
+  data.mesh = std::move(chunk.mesh.mesh);
+  if (volume.volume != InvalidVolumeHandle) // Volume still resident, compress it on the way out
+  {
+    compressVolume(volumePool->get(volume.volume), data.volume);
+  }
+  else // Already compressed after meshing, or dropped in which case there's nothing to keep
+  {
+    data.volume = std::move(volume.compressed);
+  }
+
+  if (!data.empty())
+  {
+    cache.add(key, std::move(data));
+  }
+  factory.DestroyChunk(handle);
+}
 
-  bool result = sqrdDist > chunkDespawnRadius * chunkDespawnRadius;
+void ChunkManager::clear()
+{
+  spawnCentreValid = false;
+  despawnCentreValid = false;
+  spawnBacklog.clear();
+  despawnBacklog.clear();
+  cancelledChunks.clear();
+  map.clear();
+  factory.DestroyAllChunks();
+  cache.clear();
+}
 
-  return result;
+ChunkManager::ChunkStatus ChunkManager::chunkStatus(ChunkCoord const coord)
+{
+  if (map.isChunkLoaded(coord))
+  {
+    return ChunkStatus::Loaded;
+  }
+  else if (cache.has(chunkKey(coord)))
+  {
+    return ChunkStatus::NotLoadedCached;
+  }
+  else
+  {
+    return ChunkStatus::NotLoadedNotCached;
+  }
 }
@@ -3,14 +3,23 @@
 #include "ChunkFactory.hpp"
 #include "ChunkCache.hpp"
 #include "ChunkMap.hpp"
+#include "ChunkCoord.hpp"
+#include "FrameBudget.hpp"
+#include "ColumnOccupancy.hpp"
+#include <array>
+#include <unordered_set>
 
 class ChunkManager
 {
 public:
   ChunkManager( entt::DefaultRegistry * const registry
-              , std::mutex * const registryMutex
+              , InstrumentedMutex * const registryMutex
               , VmaAllocator * const allocator
-              , VkDevice * const logicalDevice);
+              , VkDevice * const logicalDevice
+              , VolumePool * const volumePool
+              , ChunkBufferPool * const chunkBuffers
+              , ColumnOccupancy const * const occupancy
+              , ChunkTable * const chunks);
   ~ChunkManager();
 
   enum class ChunkStatus
@@ -20,34 +29,102 @@ public:
     Loaded
   };
 
-  KeyType chunkKey(glm::vec3 const pos);
-
-  // Returns a list of <EntityHandle, ChunkStatus> pairs of chunks not yet loaded into the ChunkMap
-  // These chunks may be cached, if so their volume data can be retrieved via getChunkVolumeDataFromCache
+  // Returns a list of <EntityHandle, ChunkStatus> pairs of chunks not yet loaded into the ChunkMap, closest first
+  // These chunks may be cached, if so their data can be retrieved via getChunkDataFromCache
+  // Only looks for new chunks when the player has moved into a different chunk, and then only
+  // checks the shell of chunks which have just come into range. They join a backlog which is
+  // spawned closest first, at most MaxChunkSpawnsPerUpdate (or ChunkSpawnBudgetUs) per call
   std::vector<std::pair<EntityHandle, ChunkManager::ChunkStatus>> getChunkSpawnList(glm::vec3 const playerPos);
-  bool getChunkVolumeDataFromCache(KeyType const key, ChunkCacheData & data);
+  // Retrieves the cached mesh and volume, both still encoded. Safe to call from
+  // workers without holding the registry lock, the cache locks internally
+  bool getChunkDataFromCache(KeyType const key, ChunkCacheData & data);
+  ChunkCacheStats getCacheStats();
+  size_t getCacheSize();
+  size_t getCacheBytes();
+  void setCacheBudget(size_t const budgetBytes);
 
+  // Unloads chunks outside the despawn radius, chunks a worker owns have their job cancelled
+  // and are destroyed on a later call once the job has handed them back. Call every update before
+  // getChunkSpawnList, like spawning it only looks for chunks when the player changes chunk.
+  // They join a backlog, at most MaxChunkDespawnsPerUpdate (or ChunkDespawnBudgetUs) are unloaded per call
   void despawnChunks(glm::vec3 const playerPos);
 
+  // Chunks found in or out of range which haven't been spawned or despawned yet
+  size_t getSpawnBacklog() const { return spawnBacklog.size(); }
+  size_t getDespawnBacklog() const { return despawnBacklog.size(); }
+
+  // Chunks given an entity, and chunks skipped because ColumnOccupancy showed they have no surface
+  uint64_t getChunksSpawned() const { return chunksSpawned; }
+  uint64_t getKnownEmptyChunks() const { return knownEmptyChunks; }
+
+  // Chunks within spawn range of predictedPos which aren't loaded, cached or already being
+  // prefetched, closest to the player first. They're marked in flight until finishPrefetch
+  std::vector<std::pair<KeyType, glm::vec3>> getChunkPrefetchList(glm::vec3 const playerPos, glm::vec3 const predictedPos, uint32_t const maxChunks);
+  // Hands a prefetched chunk to the cache, safe to call from workers
+  void finishPrefetch(KeyType const key, ChunkCacheData && data);
+  void cancelPrefetch(KeyType const key);
+  // Puts back data retrieved with getChunkDataFromCache which a cancelled job didn't use
+  void returnToCache(KeyType const key, ChunkCacheData && data);
+  size_t getPrefetchesInFlight();
+  uint64_t getPrefetchesIssued();
+
   // Insert a chunks handle into the chunk map
-  void loadChunk(KeyType const key, EntityHandle const handle);
+  void loadChunk(ChunkCoord const coord, EntityHandle const handle);
   
-  // Remove a chunk from the chunk map, caching its volume data and destroying its entity in the registry
-  void unloadChunk(KeyType const key);
+  // Remove a chunk from the chunk map, caching its mesh and volume data and destroying its entity in the registry.
+  // Chunk must be Retiring
+  void unloadChunk(ChunkCoord const coord);
 
   void clear();
 
 
 private:
   entt::DefaultRegistry * const registry;
-  std::mutex * const registryMutex;
+  InstrumentedMutex * const registryMutex;
+  ChunkTable * const chunks;
   VkDevice * const logicalDevice;
   VmaAllocator * const allocator;
+  VolumePool * const volumePool;
+  ColumnOccupancy const * const occupancy;
   ChunkFactory factory;
   ChunkCache cache;
   ChunkMap map;  
 
-  ChunkStatus chunkStatus(uint64_t const key);
-  bool pointInSpawnRange(glm::vec3 const playerPos, glm::vec3 const point);
-  bool pointInDespawnRange(glm::vec3 const playerPos, glm::vec3 const point);
+  // Spawn sphere offsets closest first, and for each of the 26 single chunk moves
+  // (indexed by spawnShellIndex) the offsets which weren't in range before the move
+  std::vector<ChunkCoord> const spawnOffsets;
+  std::array<std::vector<ChunkCoord>, 27> spawnShells;
+  ChunkCoord lastSpawnCentre;
+  bool spawnCentreValid = false; // Forces a full sweep, e.g. after clear
+  static size_t spawnShellIndex(ChunkCoord const delta);
+  static constexpr int32_t spawnRadiusSqrd = static_cast<int32_t>(chunkSpawnDistance * chunkSpawnDistance);
+  std::vector<ChunkCoord> spawnBacklog; // Closest to lastSpawnCentre first
+  uint64_t chunksSpawned = 0;
+  uint64_t knownEmptyChunks = 0;
+
+  // Chunks are unloaded once their offset from the player's chunk is longer than chunkDespawnRadius
+  static constexpr int32_t despawnRadiusSqrd = static_cast<int32_t>((chunkDespawnRadius * invTechnicalChunkDim) * (chunkDespawnRadius * invTechnicalChunkDim));
+  // Everything within the despawn radius, and for each single chunk move the offsets
+  // (from the previous centre) which fall out of it
+  std::vector<ChunkCoord> despawnOffsets;
+  std::array<std::vector<ChunkCoord>, 27> despawnShells;
+  ChunkCoord lastDespawnCentre;
+  bool despawnCentreValid = false;
+  std::vector<ChunkCoord> despawnBacklog;
+  // Registry lock must be held, returns false if there was no chunk entity to unload
+  bool despawnChunk(ChunkCoord const coord);
+  // Takes the chunk from the update thread's side of its lifecycle to Retiring, fails while a worker owns it
+  bool retireChunk(EntityHandle const handle);
+
+  std::mutex prefetchMutex;
+  std::unordered_set<KeyType> prefetchesInFlight;
+  uint64_t prefetchesIssued = 0;
+
+  // Chunks despawned while a worker owned them, destroyed once it hands them back
+  std::vector<EntityHandle> cancelledChunks;
+  void reapCancelledChunks();
+  // Caches whatever the chunk has built, chunk must be Retiring and the registry lock held
+  void cacheAndDestroyChunk(EntityHandle const handle, KeyType const key);
+
+  ChunkStatus chunkStatus(ChunkCoord const coord);
 };
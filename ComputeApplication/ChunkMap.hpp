@@ -1,44 +1,100 @@
 #pragma once
+#include <algorithm>
 #include <unordered_map>
-#include "glm/glm.hpp"
-#include <array>
+#include <vector>
 #include "common.hpp"
-#include "voxel.hpp"
-#include "cpp-cache/fifo-cache.h"
-#include "ChunkFactory.hpp"
+#include "ChunkCoord.hpp"
 #include "ChunkCache.hpp"
 
+// Tracks loaded chunks. x and z already wrap at WorldDimension and loaded chunks
+// stay within the despawn radius of the player, so a dense ring buffer covering
+// the whole world in x/z and ChunkMapHeight chunks in y can index them directly,
+// no hashing. Each slot remembers which y it holds, if two loaded chunks ever land
+// in the same slot (ChunkMapHeight apart vertically) the second goes in a small overflow map
 class ChunkMap
 {
 public:
-  bool isChunkLoaded(uint64_t const key)
+  // Stands in for an entity where ColumnOccupancy showed the chunk has no surface,
+  // it counts as loaded but there's nothing in the registry for it
+  static constexpr EntityHandle KnownEmpty = 0xFFFFFFFE;
+
+  ChunkMap()
+    : slots(WorldDimension * WorldDimension * ChunkMapHeight)
+  {
+    clear();
+  }
+
+  bool isChunkLoaded(ChunkCoord const coord) const
   {
-    return map.count(key) == 1 ? true : false;
+    Slot const & slot = slots[slotIndex(coord)];
+    if (slot.handle != EmptySlot && slot.y == coord.y) return true;
+    return !overflow.empty() && overflow.count(chunkKey(coord)) == 1;
   }
 
-  void loadChunk(uint64_t const key, uint32_t const entity)
+  void loadChunk(ChunkCoord const coord, EntityHandle const entity)
   {
-    map[key] = entity;
+    Slot & slot = slots[slotIndex(coord)];
+    if (slot.handle == EmptySlot || slot.y == coord.y)
+    {
+      slot.y = coord.y;
+      slot.handle = entity;
+    }
+    else
+    {
+      overflow[chunkKey(coord)] = entity;
+    }
   }
 
   //Returns entity handle so ChunkManager can cache the volume data
-  EntityHandle unloadChunk(uint64_t const key)
+  EntityHandle unloadChunk(ChunkCoord const coord)
   {
-    EntityHandle handle = map.at(key);
-    map.erase(key);
+    Slot & slot = slots[slotIndex(coord)];
+    if (slot.handle != EmptySlot && slot.y == coord.y)
+    {
+      EntityHandle handle = slot.handle;
+      slot.handle = EmptySlot;
+      return handle;
+    }
+
+    KeyType key = chunkKey(coord);
+    EntityHandle handle = overflow.at(key);
+    overflow.erase(key);
     return handle;
   }
 
-  EntityHandle get(uint64_t const key)
+  EntityHandle get(ChunkCoord const coord) const
   {
-    return map[key];
+    Slot const & slot = slots[slotIndex(coord)];
+    if (slot.handle != EmptySlot && slot.y == coord.y) return slot.handle;
+    return overflow.at(chunkKey(coord));
   }
 
   void clear()
   {
-    map.clear();
+    std::fill(slots.begin(), slots.end(), Slot{ 0, EmptySlot });
+    overflow.clear();
   }
 
 protected:
-  std::unordered_map<KeyType, EntityHandle> map; // Map tracks loaded chunks  
+  static_assert((WorldDimension & (WorldDimension - 1)) == 0, "ChunkMap masks x and z, WorldDimension must be a power of two");
+  static_assert((ChunkMapHeight & (ChunkMapHeight - 1)) == 0, "ChunkMap masks y, ChunkMapHeight must be a power of two");
+
+  static constexpr EntityHandle EmptySlot = 0xFFFFFFFF;
+
+  struct Slot
+  {
+    int32_t y;
+    EntityHandle handle;
+  };
+
+  // Masking keeps negative y in range too, two's complement wraps it round the ring
+  static size_t slotIndex(ChunkCoord const coord)
+  {
+    return (static_cast<uint32_t>(coord.x) & (WorldDimension - 1))
+         + (static_cast<uint32_t>(coord.z) & (WorldDimension - 1)) * WorldDimension
+         + (static_cast<uint32_t>(coord.y) & (ChunkMapHeight - 1)) * WorldDimension * WorldDimension;
+  }
+
+  std::vector<Slot> slots;
+  std::unordered_map<KeyType, EntityHandle> overflow; // Vertically aliased chunks, normally empty
 };
@@ -0,0 +1,149 @@
+#include "ChunkPipeline.hpp"
+#include <algorithm>
+#include <cassert>
+
+ChunkPipeline::ChunkPipeline(PriorityExecutor * const executor, std::array<uint32_t, BuildStageCount> const concurrency, std::array<size_t, BuildStageCount> const capacity)
+  : executor(executor)
+  , concurrency(concurrency)
+  , capacity(capacity)
+{
+}
+
+void ChunkPipeline::setStage(BuildStage const stage, StageFunction function)
+{
+  stages[static_cast<size_t>(stage)] = std::move(function);
+}
+
+void ChunkPipeline::setFinish(FinishFunction function)
+{
+  finish = std::move(function);
+}
+
+void ChunkPipeline::push(std::unique_ptr<ChunkBuild> build)
+{
+  std::lock_guard<std::mutex> lock(pipelineMutex);
+  auto & queue = queues[static_cast<size_t>(BuildStage::Noise)];
+  queue.push_back(std::move(build));
+
+  auto & stageStats = stats[static_cast<size_t>(BuildStage::Noise)];
+  stageStats.queuedPeak = std::max(stageStats.queuedPeak, queue.size());
+}
+
+void ChunkPipeline::dispatch()
+{
+  std::lock_guard<std::mutex> lock(pipelineMutex);
+  dispatchLocked();
+}
+
+void ChunkPipeline::dispatchLocked()
+{
+  for (size_t stage = BuildStageCount; stage-- > 0;)
+  {
+    auto & queue = queues[stage];
+    while (!queue.empty() && stats[stage].running < concurrency[stage] && hasRoomAfter(stage))
+    {
+      ChunkBuild * build = queue.front().release(); // Tasks have to be copyable, run takes ownership
+      queue.pop_front();
+      stats[stage].running++;
+
+      BuildStage const runStage = static_cast<BuildStage>(stage);
+      executor->submit(TaskPriority::Chunk, [this, runStage, build]() { run(runStage, build); });
+    }
+  }
+}
+
+void ChunkPipeline::resume(std::unique_ptr<ChunkBuild> build, BuildStage const next)
+{
+  if (next == BuildStage::Finished)
+  {
+    finish(*build);
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(pipelineMutex);
+  size_t const following = static_cast<size_t>(next);
+  queues[following].push_back(std::move(build));
+  stats[following].queuedPeak = std::max(stats[following].queuedPeak, queues[following].size());
+  dispatchLocked();
+}
+
+size_t ChunkPipeline::clear()
+{
+  std::lock_guard<std::mutex> lock(pipelineMutex);
+  size_t dropped = 0;
+  for (size_t stage = 0; stage < BuildStageCount; stage++)
+  {
+    assert(stats[stage].running == 0);
+    dropped += queues[stage].size();
+    queues[stage].clear();
+  }
+  return dropped;
+}
+
+BuildStageStats ChunkPipeline::getStats(BuildStage const stage)
+{
+  std::lock_guard<std::mutex> lock(pipelineMutex);
+  BuildStageStats stageStats = stats[static_cast<size_t>(stage)];
+  stageStats.queued = queues[static_cast<size_t>(stage)].size();
+  return stageStats;
+}
+
+void ChunkPipeline::resetQueuePeaks()
+{
+  std::lock_guard<std::mutex> lock(pipelineMutex);
+  for (size_t stage = 0; stage < BuildStageCount; stage++)
+  {
+    stats[stage].queuedPeak = queues[stage].size();
+  }
+}
+
+void ChunkPipeline::run(BuildStage stage, ChunkBuild * build)
+{
+  std::unique_ptr<ChunkBuild> owned(build);
+  while (true)
+  {
+    size_t const current = static_cast<size_t>(stage);
+    tp start = hr_clock::now();
+    BuildStage next = stages[current](*owned);
+    uint64_t busyUs = duration_cast<microseconds>(hr_clock::now() - start).count();
+
+    std::unique_lock<std::mutex> lock(pipelineMutex);
+    stats[current].running--;
+    stats[current].completed++;
+    stats[current].busyUs += busyUs;
+    if (next == BuildStage::Finished)
+    {
+      dispatchLocked(); // This stage has a free slot
+      lock.unlock();
+      finish(*owned);
+      return;
+    }
+    if (next == BuildStage::Detached)
+    {
+      dispatchLocked();
+      owned.release(); // The stage has it now, and may already have handed it back
+      return;
+    }
+
+    // Keep going on this worker rather than submitting it again, unless the stage is
+    // full or there are builds queued ahead of this one
+    size_t const following = static_cast<size_t>(next);
+    if (queues[following].empty() && stats[following].running < concurrency[following])
+    {
+      stats[following].running++;
+      dispatchLocked(); // Anything queued for the stage it's leaving takes its slot
+      stage = next;
+      continue;
+    }
+
+    queues[following].push_back(std::move(owned));
+    stats[following].queuedPeak = std::max(stats[following].queuedPeak, queues[following].size());
+    dispatchLocked();
+    return;
+  }
+}
+
+bool ChunkPipeline::hasRoomAfter(size_t const stage) const
+{
+  return stage + 1 >= BuildStageCount || queues[stage + 1].size() < capacity[stage + 1];
+}
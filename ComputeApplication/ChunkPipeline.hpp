@@ -0,0 +1,117 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "DualMC.hpp"
+#include "Vertex.hpp"
+#include "VolumePool.hpp"
+#include "ChunkCache.hpp"
+#include "ChunkScheduler.hpp"
+#include "MeshCodec.hpp"
+#include "PriorityExecutor.hpp"
+#include "metrics.hpp"
+
+// Stages of a chunk build, in order. Each has its own resource profile: noise and
+// meshing are CPU bound, the meshoptimizer passes are memory bound and staging is
+// bound by the transfer queue
+enum class BuildStage : uint32_t
+{
+  Noise,    // Generate the volume, or restore the chunk from the cache
+  Mesh,     // DualMC
+  Optimise, // meshoptimizer remap, simplify and reorder
+  Normals,  // Normals, and encoding the mesh for the cache
+  Upload,   // Staging to the GPU
+  Finished, // Not a stage, returned once the build is done or abandoned
+  Detached  // Not a stage, the stage kept the build and will hand it back with resume
+};
+static constexpr size_t BuildStageCount = static_cast<size_t>(BuildStage::Finished);
+static constexpr char const * BuildStageNames[BuildStageCount] = { "Noise", "Mesh", "Optimise", "Normals", "Upload" };
+
+// One chunk on its way through the pipeline, carries each stage's output to the next
+struct ChunkBuild
+{
+  ChunkJob job;
+  bool claimed = false;   // Job owns the chunk
+  bool completed = false; // Chunk was built, false if the build was cancelled
+  bool deferred = false;  // Stopped for want of a volume slot or a failed upload, the job goes back to the scheduler
+  VolumeHandle volume = InvalidVolumeHandle;
+  bool restored = false;  // Came from the cache, cached holds the data so it can go back if cancelled
+  ChunkCacheData cached;
+  std::vector<Vertex> generatedVerts;
+  std::vector<dualmc::TriIndexType> generatedIndices;
+  std::vector<Vertex> vertices;
+  std::vector<uint32_t> indices;
+  CompressedMesh encoded;
+  logEntryData logData;
+  std::atomic<bool> uploadHandoff{ false }; // Set by the first of the staging worker and the batch's completion
+};
+
+struct BuildStageStats
+{
+  uint64_t completed; // Builds which have left the stage
+  uint64_t busyUs;    // Total time spent running the stage, across all workers
+  uint32_t running;
+  size_t queued;      // Waiting to enter the stage
+  size_t queuedPeak;  // Since the last resetQueuePeaks
+};
+
+// Runs chunk builds through the BuildStages with a queue in front of each stage and a
+// limit on how many builds each stage runs at once, so a stage can be kept to fewer
+// workers while the rest keep generating and meshing. A worker which finishes a stage
+// carries straight on into the next when it has room, otherwise the build waits in that
+// stage's queue. Whenever a stage frees a slot or a queue drains, the worker submits
+// whatever queued builds can now start, so builds don't wait for the next update's
+// dispatch. A stage isn't dispatched while the queue after it is at capacity, so a slow
+// stage pushes back on the ones ahead of it, queues overshoot by at most the
+// concurrency of the stage before them.
+// push, dispatch and clear are for the update thread, stages run on executor workers at Chunk priority
+class ChunkPipeline
+{
+public:
+  // Runs one stage of a build, returns the stage it goes to next, Finished or Detached.
+  // A stage which returns Detached takes ownership of the build, e.g. while it waits on the GPU
+  using StageFunction = std::function<BuildStage(ChunkBuild & build)>;
+  // Called once a build is Finished, before it's freed. On the worker, or on whichever
+  // thread resumed it
+  using FinishFunction = std::function<void(ChunkBuild & build)>;
+
+  ChunkPipeline(PriorityExecutor * const executor, std::array<uint32_t, BuildStageCount> const concurrency, std::array<size_t, BuildStageCount> const capacity);
+
+  void setStage(BuildStage const stage, StageFunction function);
+  void setFinish(FinishFunction function);
+
+  // Queues a build at the Noise stage
+  void push(std::unique_ptr<ChunkBuild> build);
+  // Hands queued builds to the executor, as many as each stage's limits allow. Last stage
+  // first so the builds closest to done move before new work starts
+  void dispatch();
+  // Takes back a Detached build, queueing it at next (and starting it if there's room) or
+  // finishing it on the calling thread
+  void resume(std::unique_ptr<ChunkBuild> build, BuildStage const next);
+  // No stages may be running or builds detached, returns how many queued builds were dropped
+  size_t clear();
+
+  BuildStageStats getStats(BuildStage const stage);
+  void resetQueuePeaks();
+
+private:
+  void run(BuildStage stage, ChunkBuild * build);
+  // dispatch with pipelineMutex already held, safe from workers
+  void dispatchLocked();
+  bool hasRoomAfter(size_t const stage) const;
+
+  PriorityExecutor * const executor;
+  std::array<uint32_t, BuildStageCount> const concurrency;
+  std::array<size_t, BuildStageCount> const capacity;
+  std::array<StageFunction, BuildStageCount> stages;
+  FinishFunction finish;
+
+  std::mutex pipelineMutex;
+  std::array<std::deque<std::unique_ptr<ChunkBuild>>, BuildStageCount> queues;
+  std::array<BuildStageStats, BuildStageCount> stats = {};
+};
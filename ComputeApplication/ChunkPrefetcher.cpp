@@ -0,0 +1,39 @@
+#include "ChunkPrefetcher.hpp"
+#include "coordinatewrap.hpp"
+
+void ChunkPrefetcher::recordPosition(double const time, glm::vec3 const pos)
+{
+  newest = (newest + 1) % history.size();
+  history[newest] = { time, pos };
+  if (count < history.size()) count++;
+}
+
+bool ChunkPrefetcher::predictPosition(float const lookahead, glm::vec3 & predicted) const
+{
+  if (count < 2) return false;
+
+  // Walk back to the oldest sample still inside the window
+  Sample const & latest = history[newest];
+  size_t oldest = newest;
+  for (size_t i = 1; i < count; i++)
+  {
+    size_t index = (newest + history.size() - i) % history.size();
+    oldest = index;
+    if (latest.time - history[index].time >= velocityWindow) break;
+  }
+
+  double elapsed = latest.time - history[oldest].time;
+  if (elapsed <= 0.0) return false;
+
+  glm::vec3 velocity = toroidalDelta(history[oldest].pos, latest.pos) / static_cast<float>(elapsed);
+  if (glm::dot(velocity, velocity) < PrefetchMinSpeed * PrefetchMinSpeed) return false;
+
+  predicted = latest.pos + velocity * lookahead;
+  WrapCoordinates(predicted);
+  return true;
+}
+
+void ChunkPrefetcher::clear()
+{
+  count = 0;
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <array>
+
+// Extrapolates the camera's path from its recent positions so chunks just beyond
+// the spawn radius can be generated into the cache before the camera gets there
+class ChunkPrefetcher
+{
+public:
+  // Called once per update with the camera position
+  void recordPosition(double const time, glm::vec3 const pos);
+
+  // Where the camera should be lookahead seconds from now. False if it isn't moving
+  // fast enough for the spawn radius to fall behind, nothing worth prefetching
+  bool predictPosition(float const lookahead, glm::vec3 & predicted) const;
+
+  void clear();
+
+private:
+  struct Sample
+  {
+    double time;
+    glm::vec3 pos;
+  };
+
+  // Velocity is averaged over this window, long enough to smooth out frame jitter
+  // and short enough to follow turns
+  static constexpr double velocityWindow = 0.5;
+
+  std::array<Sample, 64> history;
+  size_t newest = 0;
+  size_t count = 0;
+};
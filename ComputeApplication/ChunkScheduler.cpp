@@ -0,0 +1,74 @@
+#include "ChunkScheduler.hpp"
+#include "coordinatewrap.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+  // Heap order puts the lowest priority value at the front
+  bool runsLater(ChunkJob const & lhs, ChunkJob const & rhs)
+  {
+    return lhs.priority > rhs.priority;
+  }
+}
+
+ChunkScheduler::ChunkScheduler()
+  : viewPos(0.f)
+  , haveFrustum(false)
+{
+}
+
+void ChunkScheduler::push(ChunkJob job)
+{
+  job.priority = score(job);
+  pending.push_back(job);
+  std::push_heap(pending.begin(), pending.end(), runsLater);
+}
+
+void ChunkScheduler::updatePriorities(glm::vec3 const cameraPos, Frustum const * frustum)
+{
+  viewPos = cameraPos;
+  haveFrustum = frustum != nullptr;
+  if (haveFrustum) viewFrustum = *frustum;
+
+  for (auto & job : pending)
+  {
+    job.priority = score(job);
+  }
+  std::make_heap(pending.begin(), pending.end(), runsLater);
+}
+
+void ChunkScheduler::pop(size_t const maxJobs, std::vector<ChunkJob> & out)
+{
+  for (size_t i = 0; i < maxJobs && !pending.empty(); i++)
+  {
+    std::pop_heap(pending.begin(), pending.end(), runsLater);
+    out.push_back(pending.back());
+    pending.pop_back();
+  }
+}
+
+size_t ChunkScheduler::size() const
+{
+  return pending.size();
+}
+
+void ChunkScheduler::clear()
+{
+  pending.clear();
+}
+
+float ChunkScheduler::score(ChunkJob const & job)
+{
+  // Unwrapped so the chunk sits on the same side of the world as the camera, like chunkIsWithinFrustum
+  glm::vec3 toChunk = toroidalDelta(viewPos, job.pos);
+  float distance = glm::length(toChunk) * invTechnicalChunkDim;
+
+  if (haveFrustum && !viewFrustum.CheckCube(viewPos + toChunk, static_cast<float>(TechnicalChunkDim)))
+  {
+    distance *= OutOfViewPriorityScale;
+  }
+
+  float surfaceDistance = std::abs(job.pos.y - job.surfaceHeight) * invTechnicalChunkDim - 0.5f;
+  return distance + SurfacePriorityWeight * std::max(surfaceDistance, 0.f);
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+#include "common.hpp"
+#include "ChunkCache.hpp"
+#include "metrics.hpp"
+#include "FrustumClass.hpp"
+#include "CancelToken.hpp"
+
+// A spawned chunk waiting to be generated or restored from the cache
+struct ChunkJob
+{
+  EntityHandle handle;
+  bool cached;         // Restore from the chunk cache rather than generate
+  glm::vec3 pos;
+  float surfaceHeight; // Heightmap height of the chunk's column in voxels, where the terrain surface should be
+  float priority;      // Lower goes first
+  tp registered;
+  CancelToken cancel;  // Shared with the chunk's ChunkRecord, cancelled if it leaves range
+};
+
+// Holds spawned chunks until there's a worker free for them and hands them out
+// best first, so the chunk under the camera isn't stuck behind far corners of the
+// spawn sphere. Priority is toroidal distance in chunks, scaled up for chunks outside
+// the view frustum and pushed back for chunks far above or below the heightmap surface
+// (likely all air or all rock). Jobs are re-scored every update so the order follows
+// the camera. Only used from the update thread, not thread safe
+class ChunkScheduler
+{
+public:
+  ChunkScheduler();
+
+  void push(ChunkJob job);
+
+  // Re-scores every pending job against the current view, frustum can be null
+  // before the first one has been built, then only distance and surface count
+  void updatePriorities(glm::vec3 const cameraPos, Frustum const * frustum);
+
+  // Moves up to maxJobs of the highest priority jobs into out
+  void pop(size_t const maxJobs, std::vector<ChunkJob> & out);
+
+  size_t size() const;
+  void clear();
+
+private:
+  float score(ChunkJob const & job);
+
+  std::vector<ChunkJob> pending; // Heap, best job at the front
+  glm::vec3 viewPos;
+  Frustum viewFrustum;
+  bool haveFrustum;
+};
@@ -0,0 +1,39 @@
+#include "ChunkTable.hpp"
+#include <cassert>
+
+ChunkTable::ChunkTable()
+  : blocks(std::make_unique<std::unique_ptr<Slot[]>[]>(MaxBlocks))
+{
+}
+
+ChunkTable::~ChunkTable()
+{
+}
+
+ChunkRecord & ChunkTable::create(EntityHandle const handle, glm::vec3 const pos, VmaAllocator * const allocator)
+{
+  auto & block = blocks[index(handle) / BlockSize];
+  if (!block)
+  {
+    block = std::make_unique<Slot[]>(BlockSize);
+  }
+
+  Slot & created = block[index(handle) % BlockSize];
+  assert(static_cast<ChunkLifecycle>(created.tag.load() & 0xFF) == ChunkLifecycle::Free);
+  created.record.pos = pos;
+  created.record.cancel = CancelToken();
+  created.record.volume = { InvalidVolumeHandle, CompressedVolume() }; // Volume slot is acquired when the chunk is built
+  created.record.model = { VkBuffer(), VkBuffer(), allocator, 0ui32 };
+  created.record.mesh = MeshCacheData();
+  created.tag.store(tag(handle, ChunkLifecycle::Queued), std::memory_order_release);
+
+  return created.record;
+}
+
+void ChunkTable::destroy(EntityHandle const handle)
+{
+  Slot & destroyed = slot(handle);
+  destroyed.record.volume.compressed = CompressedVolume();
+  destroyed.record.mesh = MeshCacheData();
+  destroyed.tag.store(tag(handle, ChunkLifecycle::Free), std::memory_order_release);
+}
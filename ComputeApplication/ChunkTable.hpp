@@ -0,0 +1,108 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <glm\glm.hpp>
+#include <entt\entity\registry.hpp>
+#include "components.hpp"
+#include "ChunkCache.hpp"
+#include "CancelToken.hpp"
+
+// Where a chunk is in its life. The update thread owns a chunk while it's Queued,
+// Resident or Retiring, a worker owns it exclusively while it's in one of the build
+// stages. Only the owner may touch the chunk's record
+enum class ChunkLifecycle : uint8_t
+{
+  Free,       // No chunk, or the handle is stale
+  Queued,     // Spawned, waiting for a job (or a cancelled job let go of it)
+  Generating, // Worker is generating the volume or restoring it from the cache
+  Meshing,    // Worker is extracting the surface
+  Uploading,  // Worker is copying the mesh to the GPU
+  Resident,   // Built, drawn if it has a mesh
+  Retiring    // Update thread is caching and destroying it
+};
+
+// Everything about a chunk which the build stages read or write. Kept out of the
+// registry so workers never need the registry lock, only the update thread uses the registry
+struct ChunkRecord
+{
+  glm::vec3 pos;      // Fixed for the chunk's life
+  CancelToken cancel; // Fixed for the chunk's life, cancelled when it leaves range
+  VolumeData volume;
+  ModelData model;
+  MeshCacheData mesh;
+};
+
+// Stable storage for ChunkRecords indexed by entity. Records live in blocks which are
+// never moved or freed until the table is destroyed, unlike entt's component pools which
+// shuffle on every create and destroy. Each record carries an atomic tag of the owning
+// entity (whose entt version is its generation) and lifecycle state, so ownership changes
+// hands with a single compare and swap and a stale handle from a destroyed chunk never
+// matches a record which has been reused
+class ChunkTable
+{
+public:
+  ChunkTable();
+  ~ChunkTable();
+
+  ChunkTable(ChunkTable const &) = delete;
+  ChunkTable & operator=(ChunkTable const &) = delete;
+
+  // Structural, registry lock must be held. The chunk starts Queued
+  ChunkRecord & create(EntityHandle const handle, glm::vec3 const pos, VmaAllocator * const allocator);
+  // Structural, registry lock must be held. Caller must own the chunk
+  void destroy(EntityHandle const handle);
+
+  // Caller must own the chunk, or only read its fixed members
+  ChunkRecord & get(EntityHandle const handle)
+  {
+    return blocks[index(handle) / BlockSize][index(handle) % BlockSize].record;
+  }
+
+  // Takes the chunk from one state to another, fails if it isn't in from or the handle is stale
+  bool transition(EntityHandle const handle, ChunkLifecycle const from, ChunkLifecycle const to)
+  {
+    uint64_t expected = tag(handle, from);
+    return slot(handle).tag.compare_exchange_strong(expected, tag(handle, to), std::memory_order_acq_rel, std::memory_order_acquire);
+  }
+
+  // Owner moving its chunk on, e.g. from one build stage to the next or handing it back
+  void advance(EntityHandle const handle, ChunkLifecycle const to)
+  {
+    slot(handle).tag.store(tag(handle, to), std::memory_order_release);
+  }
+
+  // Free if the handle is stale
+  ChunkLifecycle state(EntityHandle const handle) const
+  {
+    uint64_t current = blocks[index(handle) / BlockSize][index(handle) % BlockSize].tag.load(std::memory_order_acquire);
+    if (static_cast<EntityHandle>(current >> 8) != handle) return ChunkLifecycle::Free;
+    return static_cast<ChunkLifecycle>(current & 0xFF);
+  }
+
+private:
+  struct Slot
+  {
+    std::atomic<uint64_t> tag{ 0 }; // Entity << 8 | ChunkLifecycle
+    ChunkRecord record;
+  };
+
+  static constexpr uint32_t BlockSize = 1024;
+  static constexpr uint32_t MaxBlocks = (entt::entt_traits<EntityHandle>::entity_mask + 1) / BlockSize;
+
+  static uint32_t index(EntityHandle const handle)
+  {
+    return handle & entt::entt_traits<EntityHandle>::entity_mask;
+  }
+  static uint64_t tag(EntityHandle const handle, ChunkLifecycle const state)
+  {
+    return (static_cast<uint64_t>(handle) << 8) | static_cast<uint64_t>(state);
+  }
+  Slot & slot(EntityHandle const handle)
+  {
+    return blocks[index(handle) / BlockSize][index(handle) % BlockSize];
+  }
+
+  // Fixed size, blocks are only added by create so a chunk's block exists before it's handed to a worker
+  std::unique_ptr<std::unique_ptr<Slot[]>[]> blocks;
+};
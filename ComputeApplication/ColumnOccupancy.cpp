@@ -0,0 +1,51 @@
+#include "ColumnOccupancy.hpp"
+#include "TerrainGenerator.hpp"
+
+ColumnOccupancy::ColumnOccupancy()
+{
+  reset();
+}
+
+void ColumnOccupancy::reset()
+{
+  for (auto & column : columns)
+  {
+    column.built.store(false, std::memory_order_relaxed);
+  }
+}
+
+void ColumnOccupancy::buildColumn(TerrainGenerator & terrainGen, int32_t const x, int32_t const z)
+{
+  float lowestHeight, highestHeight;
+  terrainGen.columnHeightRange(chunkWorldPos({ x, 0, z }), lowestHeight, highestHeight);
+
+  // A voxel's density is heightmap height - y plus the noise, the surface is where that
+  // crosses zero. A little slack on the noise bound covers the noise's own overshoot
+  constexpr float displacement = TerrainGenerator::MaxNoiseDisplacement * 1.05f + 1.f;
+  Column & column = columns[x + z * WorldDimension];
+  column.lowestSurface = lowestHeight - displacement;
+  column.highestSurface = highestHeight + displacement;
+  column.built.store(true, std::memory_order_release);
+}
+
+bool ColumnOccupancy::mayHaveSurface(ChunkCoord const coord) const
+{
+  ChunkCoord wrapped = wrapChunkCoord(coord);
+  Column const & column = columns[wrapped.x + wrapped.z * WorldDimension];
+  if (!column.built.load(std::memory_order_acquire)) return true;
+
+  // genVolume samples y from the chunk's origin - HalfChunkDim for TrueChunkDim voxels
+  float bottom = chunkWorldPos(wrapped).y - static_cast<float>(HalfChunkDim);
+  float top = bottom + static_cast<float>(TrueChunkDim - 1);
+  return top >= column.lowestSurface && bottom <= column.highestSurface;
+}
+
+uint32_t ColumnOccupancy::columnsBuilt() const
+{
+  uint32_t built = 0;
+  for (auto const & column : columns)
+  {
+    if (column.built.load(std::memory_order_relaxed)) built++;
+  }
+  return built;
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include "common.hpp"
+#include "ChunkCoord.hpp"
+
+class TerrainGenerator;
+
+// For each chunk column (x,z) the lowest and highest the terrain surface can be,
+// from the column's heightmap range widened by the most genVolume's noise can move
+// the surface. Chunks entirely above or below that band have no surface to mesh,
+// so ChunkManager records them as known empty instead of spawning them. Columns
+// are built on workers after each seed change, until a column is built every chunk
+// in it may have a surface
+class ColumnOccupancy
+{
+public:
+  ColumnOccupancy();
+
+  // Forget every column, call before changing the seed (no builds may be running)
+  void reset();
+
+  // Samples the column's heightmap, safe to call for different columns in parallel
+  void buildColumn(TerrainGenerator & terrainGen, int32_t const x, int32_t const z);
+
+  // False only if the chunk provably has no surface
+  bool mayHaveSurface(ChunkCoord const coord) const;
+
+  uint32_t columnsBuilt() const;
+
+private:
+  struct Column
+  {
+    std::atomic<bool> built;
+    float lowestSurface, highestSurface; // World y in voxels
+  };
+
+  std::array<Column, WorldDimension * WorldDimension> columns;
+};
@@ -3,6 +3,8 @@
 #include "coordinatewrap.hpp"
 #include "syncout.hpp"
 #include <random>
+#include <algorithm>
+#include <cmath>
 
 bool ComputeApp::Initialise(VulkanInterface::WindowParameters windowParameters)
 {
@@ -37,10 +39,11 @@ bool ComputeApp::Initialise(VulkanInterface::WindowParameters windowParameters)
   {
     return false;
   }
+  setupChunkPipeline();
 
   // Prepare setup tasks
-  bool resVMA, resCmdBufs, resRenderpass, resGpipe, resChnkMngr, resTerGen, resECS, resSurface;
-  auto[vma, commandBuffers, renderpass, gpipeline, frameres, chunkmanager, terraingen, surface, ecs] = systemTaskflow->emplace(
+  bool resVMA, resCmdBufs, resRenderpass, resGpipe, resChnkMngr, resTerGen, resECS, resSurface, resVolPool;
+  auto[vma, commandBuffers, renderpass, gpipeline, frameres, chunkmanager, terraingen, surface, ecs, volumepool] = systemTaskflow->emplace(
     [&]() { resVMA = initialiseVulkanMemoryAllocator(); },
     [&]() { resCmdBufs = setupCommandPoolAndBuffers(); },
     [&]() { resRenderpass = setupRenderPass(); },
@@ -53,26 +56,32 @@ bool ComputeApp::Initialise(VulkanInterface::WindowParameters windowParameters)
       resChnkMngr = setupChunkManager(); },
     [&]() { resTerGen = setupTerrainGenerator(); },
     [&]() { resSurface = setupSurfaceExtractor(); },
-    [&]() { resECS = setupECS(); }
+    [&]() { resECS = setupECS(); },
+    [&]() { resVolPool = setupVolumePool(); }
   );
 
   // Task dependencies
   vma.precede(gpipeline);
   vma.precede(chunkmanager);
   vma.precede(frameres);
+  vma.precede(surface);
   renderpass.precede(gpipeline);
   ecs.precede(chunkmanager);
   commandBuffers.precede(surface);
   commandBuffers.precede(frameres);
+  volumepool.precede(chunkmanager);
+  volumepool.precede(surface);
 
   // Execute and wait for completion
   systemTaskflow->dispatch().get();  
 
-  if (!resVMA || !resCmdBufs || !resRenderpass || !resGpipe || !resChnkMngr || !resTerGen || !resSurface || !resECS)
+  if (!resVMA || !resCmdBufs || !resRenderpass || !resGpipe || !resChnkMngr || !resTerGen || !resSurface || !resECS || !resVolPool)
   {
     return false;
   }
 
+  buildColumnOccupancy();
+
   return true;
 }
 
@@ -80,8 +89,10 @@ bool ComputeApp::InitMetrics()
 {
   logging = true;
   logFile = createLogFile();
+  countersLogFile = createLogFile("LogCounters");
+  cacheHitLogFile = createLogFile("LogCacheHits");
   
-  if (!logFile.is_open())
+  if (!logFile.is_open() || !countersLogFile.is_open() || !cacheHitLogFile.is_open())
   {
     return false;
   }
@@ -89,10 +100,191 @@ bool ComputeApp::InitMetrics()
   {
     // Write data headings to first line, csv format
     logFile << "key,heightElapsed,volumeElapsed,surfaceElapsed,timeElapsed,timeSinceRegistered" << std::endl;
+    countersLogFile << "time,counter,value" << std::endl;
+    cacheHitLogFile << "key,restoreElapsed,timeElapsed,timeSinceRegistered,meshFromCache" << std::endl;
+    return true;
+  }
+}
+
+bool ComputeApp::InitCameraPathRecording()
+{
+  recordingCameraPath = true;
+  cameraPathFile = createLogFile("CameraPath");
+
+  if (!cameraPathFile.is_open())
+  {
+    return false;
+  }
+  else
+  {
+    cameraPathFile << "time,x,y,z" << std::endl;
     return true;
   }
 }
 
+bool ComputeApp::InitCameraPathPlayback(std::string const & filename)
+{
+  playingCameraPath = LoadCameraPath(filename, cameraPath);
+  return playingCameraPath;
+}
+
+void ComputeApp::SetPrefetching(bool const enabled)
+{
+  prefetching = enabled;
+}
+
+void ComputeApp::SetThreadTopology(ThreadTopologyConfig const & config)
+{
+  threadTopologyConfig = config;
+}
+
+void ComputeApp::SetChunkCacheBudget(size_t const budgetBytes)
+{
+  chunkCacheBudget = budgetBytes;
+  if (chunkManager)
+  {
+    chunkManager->setCacheBudget(chunkCacheBudget);
+  }
+}
+
+void ComputeApp::logCounters()
+{
+  // Chunks still being built belong to their workers, only count the finished ones
+  uint64_t compressedVolumes = 0, compressedBytes = 0, encodedMeshBytes = 0;
+  registry->view<WorldPosition>().each(
+    [&](const uint32_t entity, auto &)
+    {
+      if (chunkTable.state(entity) != ChunkLifecycle::Resident) return;
+
+      ChunkRecord const & chunk = chunkTable.get(entity);
+      if (!chunk.volume.compressed.empty())
+      {
+        compressedVolumes++;
+        compressedBytes += chunk.volume.compressed.bytes();
+      }
+      encodedMeshBytes += chunk.mesh.mesh.bytes();
+    }
+  );
+
+  insertCounter(countersLogFile, gameTime, "residentVolumes", volumePool->inUse());
+  insertCounter(countersLogFile, gameTime, "residentVolumeBytes", volumePool->inUse() * sizeof(ChunkVolume));
+  insertCounter(countersLogFile, gameTime, "compressedVolumes", compressedVolumes);
+  insertCounter(countersLogFile, gameTime, "compressedVolumeBytes", compressedBytes);
+  insertCounter(countersLogFile, gameTime, "encodedMeshBytes", encodedMeshBytes);
+
+  // Cache does its own locking
+  ChunkCacheStats cacheStats = chunkManager->getCacheStats();
+  insertCounter(countersLogFile, gameTime, "cacheEntries", chunkManager->getCacheSize());
+  insertCounter(countersLogFile, gameTime, "cacheBytes", chunkManager->getCacheBytes());
+  insertCounter(countersLogFile, gameTime, "cacheBudget", chunkCacheBudget);
+  insertCounter(countersLogFile, gameTime, "cacheHits", cacheStats.hits);
+  insertCounter(countersLogFile, gameTime, "cacheMisses", cacheStats.misses);
+  insertCounter(countersLogFile, gameTime, "cacheEvictions", cacheStats.evictions);
+  insertCounter(countersLogFile, gameTime, "prefetchIssued", chunkManager->getPrefetchesIssued());
+  insertCounter(countersLogFile, gameTime, "prefetchInFlight", chunkManager->getPrefetchesInFlight());
+  insertCounter(countersLogFile, gameTime, "prefetchUsed", cacheStats.prefetchUsed);
+  insertCounter(countersLogFile, gameTime, "prefetchWasted", cacheStats.prefetchWasted);
+
+  insertCounter(countersLogFile, gameTime, "chunkJobsQueued", chunkScheduler.size());
+  insertCounter(countersLogFile, gameTime, "chunkJobsInFlight", chunkJobsInFlight.load());
+  insertCounter(countersLogFile, gameTime, "chunkJobsCancelled", chunkJobsCancelled.load());
+  insertCounter(countersLogFile, gameTime, "chunkJobsDeferred", chunkJobsDeferred.load());
+  insertCounter(countersLogFile, gameTime, "chunkJobsWasted", chunkJobsWasted.load());
+  insertCounter(countersLogFile, gameTime, "chunkJobsCompleted", chunkJobsCompleted.load());
+  insertCounter(countersLogFile, gameTime, "chunksSpawned", chunkManager->getChunksSpawned());
+  insertCounter(countersLogFile, gameTime, "knownEmptyChunks", chunkManager->getKnownEmptyChunks());
+  insertCounter(countersLogFile, gameTime, "occupancyColumnsBuilt", columnOccupancy.columnsBuilt());
+  insertCounter(countersLogFile, gameTime, "spawnBacklog", chunkManager->getSpawnBacklog());
+  insertCounter(countersLogFile, gameTime, "spawnBacklogPeak", spawnBacklogPeak);
+  insertCounter(countersLogFile, gameTime, "despawnBacklog", chunkManager->getDespawnBacklog());
+  insertCounter(countersLogFile, gameTime, "despawnBacklogPeak", despawnBacklogPeak);
+  spawnBacklogPeak = 0;
+  despawnBacklogPeak = 0;
+  ChunkBufferStats bufferStats = chunkBuffers->getStats();
+  insertCounter(countersLogFile, gameTime, "chunkBuffersRetiring", bufferStats.pendingRetirements);
+  insertCounter(countersLogFile, gameTime, "chunkBufferBytesRetiring", bufferStats.pendingBytes);
+  insertCounter(countersLogFile, gameTime, "chunkBufferPages", bufferStats.pages);
+  insertCounter(countersLogFile, gameTime, "chunkBufferPageBytes", bufferStats.pageBytes);
+  insertCounter(countersLogFile, gameTime, "chunkBufferBytesUsed", bufferStats.usedBytes);
+  insertCounter(countersLogFile, gameTime, "chunkBufferLargestFreeBytes", bufferStats.largestFreeBytes);
+  insertCounter(countersLogFile, gameTime, "chunkBufferAllocations", bufferStats.allocations);
+  insertCounter(countersLogFile, gameTime, "chunkBufferAllocationFailures", bufferStats.allocationFailures);
+  insertCounter(countersLogFile, gameTime, "chunkBufferAllocateNs", bufferStats.allocateNs);
+  insertCounter(countersLogFile, gameTime, "chunkBufferMoves", bufferStats.moves);
+  // Draw calls recorded for chunks and time spent building their indirect commands, since the last sample
+  insertCounter(countersLogFile, gameTime, "chunkDrawCalls", chunkDrawCalls);
+  insertCounter(countersLogFile, gameTime, "chunkDrawListNs", chunkDrawListNs);
+  chunkDrawCalls = 0;
+  chunkDrawListNs = 0;
+  insertCounter(countersLogFile, gameTime, "frameTimeMaxUs", static_cast<uint64_t>(frameTimeMaxMs * 1000.0));
+  frameTimeMaxMs = 0.0;
+  if (frameTimeSamples > 0)
+  {
+    // Standard deviation of the frame time, what the topology is meant to keep down
+    double mean = frameTimeSumMs / frameTimeSamples;
+    double variance = std::max(frameTimeSumSqMs / frameTimeSamples - mean * mean, 0.0);
+    insertCounter(countersLogFile, gameTime, "frameTimeJitterUs", static_cast<uint64_t>(std::sqrt(variance) * 1000.0));
+    frameTimeSumMs = frameTimeSumSqMs = 0.0;
+    frameTimeSamples = 0;
+  }
+
+  // Cumulative, how often creating and destroying chunks had to wait on the registry lock and for how long
+  LockStats registryLock = registryMutex.getStats();
+  insertCounter(countersLogFile, gameTime, "registryLocks", registryLock.acquisitions);
+  insertCounter(countersLogFile, gameTime, "registryLocksContended", registryLock.contended);
+  insertCounter(countersLogFile, gameTime, "registryLockWaitUs", registryLock.waitedNs / 1000);
+
+  // Cumulative, uploads from workers should never show up in the locked counts
+  TransferPoolStats transferStats = commandPools->transferPools.getStats();
+  insertCounter(countersLogFile, gameTime, "transferBuffersUnlocked", transferStats.workerLeases);
+  insertCounter(countersLogFile, gameTime, "transferBuffersLocked", transferStats.shared.acquisitions);
+  insertCounter(countersLogFile, gameTime, "transferBufferLocksContended", transferStats.shared.contended);
+
+  // Cumulative, uploads per second is the change in uploadsBatched between samples.
+  // uploadBlockedUs is worker time lost waiting for ring space, it should stay flat
+  UploadBatcherStats uploadStats = uploadBatcher->getStats();
+  insertCounter(countersLogFile, gameTime, "uploadsBatched", uploadStats.uploads);
+  insertCounter(countersLogFile, gameTime, "uploadBatches", uploadStats.batches);
+  insertCounter(countersLogFile, gameTime, "uploadBytes", uploadStats.bytes);
+  insertCounter(countersLogFile, gameTime, "uploadBlockedUs", uploadStats.blockedUs);
+  insertCounter(countersLogFile, gameTime, "uploadRingBytesInUse", uploadStats.ringBytesInUse);
+  insertCounter(countersLogFile, gameTime, "uploadsDirect", uploadsDirect.load());
+  insertCounter(countersLogFile, gameTime, "uploadDirectUs", uploadDirectUs.load());
+
+  // Completed and busy time are cumulative, throughput is the change between samples
+  for (size_t stage = 0; stage < BuildStageCount; stage++)
+  {
+    BuildStageStats stageStats = chunkPipeline->getStats(static_cast<BuildStage>(stage));
+    std::string prefix = std::string("pipeline") + BuildStageNames[stage];
+    insertCounter(countersLogFile, gameTime, (prefix + "Completed").c_str(), stageStats.completed);
+    insertCounter(countersLogFile, gameTime, (prefix + "BusyUs").c_str(), stageStats.busyUs);
+    insertCounter(countersLogFile, gameTime, (prefix + "Running").c_str(), stageStats.running);
+    insertCounter(countersLogFile, gameTime, (prefix + "Queued").c_str(), stageStats.queued);
+    insertCounter(countersLogFile, gameTime, (prefix + "QueuedPeak").c_str(), stageStats.queuedPeak);
+  }
+  chunkPipeline->resetQueuePeaks();
+
+  for (size_t level = 0; level < TaskPriorityCount; level++)
+  {
+    TaskPriorityStats levelStats = computeExecutor->getStats(static_cast<TaskPriority>(level));
+    std::string prefix = std::string("executor") + TaskPriorityNames[level];
+    insertCounter(countersLogFile, gameTime, (prefix + "Completed").c_str(), levelStats.completed);
+    insertCounter(countersLogFile, gameTime, (prefix + "Stolen").c_str(), levelStats.stolen);
+    insertCounter(countersLogFile, gameTime, (prefix + "Promoted").c_str(), levelStats.promoted);
+    insertCounter(countersLogFile, gameTime, (prefix + "WaitUs").c_str(), levelStats.waitUs);
+    insertCounter(countersLogFile, gameTime, (prefix + "WaitMaxUs").c_str(), levelStats.waitMaxUs);
+  }
+  computeExecutor->resetPeaks();
+  {
+    std::lock_guard<std::mutex> lock(timeToVisibleMutex);
+    if (timeToVisibleMs >= 0.0) // Only logged once per teleport
+    {
+      insertCounter(countersLogFile, gameTime, "timeToVisibleUs", static_cast<uint64_t>(timeToVisibleMs * 1000.0));
+      timeToVisibleMs = -1.0;
+    }
+  }
+}
+
 bool ComputeApp::Update()
 {
   gameTime += TimerState.GetDeltaTime();
@@ -101,19 +293,26 @@ bool ComputeApp::Update()
   {
     syncout() << "Reseeding terrain, wait for device idle\n";
     vkDeviceWaitIdle(*vulkanDevice); // Wait for idle (eck)
-    syncout() << "Waiting for compute taskflow to complete\n";
-    computeTaskflow->wait_for_all(); // Flush compute tasks
+    syncout() << "Waiting for compute tasks to complete\n";
+    finishComputeWork(); // Flush compute tasks
+    chunkJobsInFlight -= static_cast<uint32_t>(chunkPipeline->clear()); // Builds waiting between stages
     chunkManager->clear(); // Destroy old chunks
+    chunkScheduler.clear(); // Jobs for chunks which no longer exist
+    deferredChunkJobs.clear();
+    pendingChunkJobs = 0;
+    lastCameraChunkValid = false;
     syncout() << "Reseeding terrain generator" << std::endl;
+    columnOccupancy.reset(); // Surface bounds belong to the old seed
     terrainGen->SetSeed(std::random_device()()); // Reseed terrain generator
+    buildColumnOccupancy();
     reseedTerrain = false;
     // Then continue as usual
   }
 
   auto[userUpdate, spawnChunks, renderList] = updateTaskflow->emplace(
-    [&]() { updateUser(); },
-    [&]() { checkForNewChunks(); },
-    [&]() { getChunkRenderList(); }
+    [&]() { threadTopology.pinFrameThread(); updateUser(); },
+    [&]() { threadTopology.pinFrameThread(); checkForNewChunks(); },
+    [&]() { threadTopology.pinFrameThread(); getChunkRenderList(); }
   );
 
   userUpdate.precede(spawnChunks);
@@ -121,6 +320,11 @@ bool ComputeApp::Update()
   spawnChunks.precede(renderList);
 
   updateTaskflow->dispatch().get();
+  if (recordingCameraPath)
+  {
+    glm::vec3 pos = camera.GetPosition();
+    cameraPathFile << gameTime << "," << pos.x << "," << pos.y << "," << pos.z << "\n";
+  }
   {
     static float updateRefreshTimer = 0.f;
     updateRefreshTimer += TimerState.GetDeltaTime();
@@ -132,6 +336,24 @@ bool ComputeApp::Update()
   }
   drawChunks();
 
+  if (logging)
+  {
+    double frameMs = TimerState.GetDeltaTime() * 1000.0;
+    frameTimes.record(frameMs);
+    frameTimeMaxMs = std::max(frameTimeMaxMs, frameMs);
+    frameTimeSumMs += frameMs;
+    frameTimeSumSqMs += frameMs * frameMs;
+    frameTimeSamples++;
+
+    static float counterLogTimer = 0.f;
+    counterLogTimer += TimerState.GetDeltaTime();
+    if (counterLogTimer > 1.f)
+    {
+      logCounters();
+      counterLogTimer = 0.f;
+    }
+  }
+
   return true;
 }
 
@@ -262,6 +484,12 @@ bool ComputeApp::setupVulkanAndCreateSwapchain(VulkanInterface::WindowParameters
         {graphicsQueueParameters.familyIndex, queuePriorities} // One graphics queue, one transfer queue
       };
 
+      // Chunks are drawn by indirect draws which find their model matrix through firstInstance,
+      // without both drawChunks records the same commands as single draws
+      desiredDeviceFeatures = {};
+      desiredDeviceFeatures.multiDrawIndirect = features.multiDrawIndirect;
+      desiredDeviceFeatures.drawIndirectFirstInstance = features.drawIndirectFirstInstance;
+
       VulkanInterface::InitVulkanHandle(vulkanDevice);
       if (!VulkanInterface::CreateLogicalDevice(physicalDevice, requestedQueues, desiredDeviceExtensions, desiredLayers, &desiredDeviceFeatures, *vulkanDevice))
       {
@@ -272,6 +500,7 @@ bool ComputeApp::setupVulkanAndCreateSwapchain(VulkanInterface::WindowParameters
       else
       {
         vulkanPhysicalDevice = physicalDevice;
+        multiDrawIndirect = features.multiDrawIndirect == VK_TRUE && features.drawIndirectFirstInstance == VK_TRUE;
         VulkanInterface::LoadDeviceLevelVulkanFunctions(*vulkanDevice, desiredDeviceExtensions);
         // Retrieve graphics queue handle
         vkGetDeviceQueue(*vulkanDevice, graphicsQueueParameters.familyIndex, 0, &graphicsQueue);
@@ -311,16 +540,37 @@ bool ComputeApp::setupVulkanAndCreateSwapchain(VulkanInterface::WindowParameters
 
 bool ComputeApp::setupTaskflow()
 {
-  tfExecutor = std::make_shared<tf::Taskflow::Executor>(std::thread::hardware_concurrency()); // maybe -1?
+  threadTopology = ThreadTopology(threadTopologyConfig);
+  threadTopology.pinFrameThread(); // Initialise runs on the main thread
+  syncout() << "Thread topology " << threadTopology.name() << ", " << threadTopology.chunkWorkers() << " chunk workers\n";
 
+  // Only the update and compute threads do any work once we're running, the system
+  // taskflow sleeps between startup and shutdown
   updateTaskflow = std::make_unique<tf::Taskflow>(2);
-  graphicsTaskflow = std::make_unique<tf::Taskflow>(std::thread::hardware_concurrency()-2);
-  computeTaskflow = std::make_unique<tf::Taskflow>(std::thread::hardware_concurrency()-2);
+  computeExecutor = std::make_unique<PriorityExecutor>(threadTopology.chunkWorkers(), ExecutorStarvationLimit,
+    [this](uint32_t const worker) { threadTopology.pinChunkWorker(worker); });
   systemTaskflow = std::make_unique<tf::Taskflow>(std::thread::hardware_concurrency());
 
   return true;
 }
 
+void ComputeApp::setupChunkPipeline()
+{
+  uint32_t workers = computeExecutor->numWorkers();
+  uint32_t uploaders = UploadStageConcurrency == 0 ? workers : std::min<uint32_t>(UploadStageConcurrency, workers);
+  std::array<uint32_t, BuildStageCount> concurrency = { workers, workers, workers, workers, uploaders };
+  std::array<size_t, BuildStageCount> capacity;
+  capacity.fill(BuildStageQueueCapacity);
+  chunkPipeline = std::make_unique<ChunkPipeline>(computeExecutor.get(), concurrency, capacity);
+
+  chunkPipeline->setStage(BuildStage::Noise, [this](ChunkBuild & build) { return noiseStage(build); });
+  chunkPipeline->setStage(BuildStage::Mesh, [this](ChunkBuild & build) { return meshStage(build); });
+  chunkPipeline->setStage(BuildStage::Optimise, [this](ChunkBuild & build) { return optimiseStage(build); });
+  chunkPipeline->setStage(BuildStage::Normals, [this](ChunkBuild & build) { return normalsStage(build); });
+  chunkPipeline->setStage(BuildStage::Upload, [this](ChunkBuild & build) { return uploadStage(build); });
+  chunkPipeline->setFinish([this](ChunkBuild & build) { finishBuild(build); });
+}
+
 bool ComputeApp::initialiseVulkanMemoryAllocator()
 {
   VmaAllocatorCreateInfo allocatorInfo = {};
@@ -334,18 +584,17 @@ bool ComputeApp::initialiseVulkanMemoryAllocator()
   }
   else
   {
+    chunkBuffers = std::make_unique<ChunkBufferPool>(&*vulkanDevice, &allocator, ChunkBufferPageBytes);
     return true;
   }
 }
 
 bool ComputeApp::setupCommandPoolAndBuffers()
 {
-  uint32_t numWorkers = static_cast<uint32_t>(graphicsTaskflow->num_workers());
-
   commandPools = std::make_unique<TaskflowCommandPools>(
     &*vulkanDevice
     , graphicsQueueParameters.familyIndex
-    , numWorkers);
+    , computeExecutor.get());
 
   return true;
 }
@@ -430,11 +679,13 @@ bool ComputeApp::setupGraphicsPipeline()
 {
   // 1 for each frame index
   viewprojUBuffers.resize(3);
-  modelUBuffers.resize(3);
+  modelBuffers.resize(3);
   lightUBuffers.resize(3);
+  indirectBuffers.resize(3);
   viewprojAllocs.resize(3);
   modelAllocs.resize(3);
   lightAllocs.resize(3);
+  indirectAllocs.resize(3);
 
   for (int i = 0; i < 3; i++)
   {
@@ -450,16 +701,11 @@ bool ComputeApp::setupGraphicsPipeline()
       return false;
     }
 
-    VkPhysicalDeviceProperties props;
-    vkGetPhysicalDeviceProperties(vulkanPhysicalDevice, &props);
-    size_t deviceAlignment = props.limits.minUniformBufferOffsetAlignment;
-    dynamicAlignment = (sizeof(PerChunkData) / deviceAlignment) * deviceAlignment + ((sizeof(PerChunkData) % deviceAlignment) > 0 ? deviceAlignment : 0);
-
-    // Always mapped model buffer for easy copy
+    // Always mapped model buffer for easy copy, read by the vertex shader as an array indexed by instance
     if (!VulkanInterface::CreateBuffer(allocator
-      , dynamicAlignment * 256
-      , VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT
-      , modelUBuffers[i]
+      , sizeof(PerChunkData) * MaxRenderedChunks
+      , VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+      , modelBuffers[i]
       , VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_STRATEGY_BEST_FIT_BIT
       , VMA_MEMORY_USAGE_UNKNOWN
       , VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
@@ -479,6 +725,19 @@ bool ComputeApp::setupGraphicsPipeline()
     {
       return false;
     }
+
+    // Always mapped too, drawChunks writes the frame's draw commands straight into it
+    if (!VulkanInterface::CreateBuffer(allocator
+      , sizeof(VkDrawIndexedIndirectCommand) * MaxRenderedChunks
+      , VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT
+      , indirectBuffers[i]
+      , VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_STRATEGY_BEST_FIT_BIT
+      , VMA_MEMORY_USAGE_UNKNOWN
+      , VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+      , VK_NULL_HANDLE, indirectAllocs[i]))
+    {
+      return false;
+    }
   }
 
   // Descriptor set with uniform buffer
@@ -492,7 +751,7 @@ bool ComputeApp::setupGraphicsPipeline()
     },
     { // Model
       1,
-      VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+      VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
       1,
       VK_SHADER_STAGE_VERTEX_BIT,
       nullptr
@@ -515,12 +774,12 @@ bool ComputeApp::setupGraphicsPipeline()
       VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,          // VkDescriptorType     type
       2*3                                           // uint32_t             descriptorCount
   };
-  VkDescriptorPoolSize descriptorPoolSizeUBD = {
-      VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,          // VkDescriptorType     type
+  VkDescriptorPoolSize descriptorPoolSizeSB = {
+      VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,          // VkDescriptorType     type
       1*3                                           // uint32_t             descriptorCount
   };
 
-  if (!VulkanInterface::CreateDescriptorPool(*vulkanDevice, false, 3, { descriptorPoolSizeUB, descriptorPoolSizeUBD }, descriptorPool))
+  if (!VulkanInterface::CreateDescriptorPool(*vulkanDevice, false, 3, { descriptorPoolSizeUB, descriptorPoolSizeSB }, descriptorPool))
   {
     return false;
   }
@@ -549,10 +808,10 @@ bool ComputeApp::setupGraphicsPipeline()
         descriptorSets[i],                          // VkDescriptorSet                      TargetDescriptorSet
         1,                                          // uint32_t                             TargetDescriptorBinding
         0,                                          // uint32_t                             TargetArrayElement
-        VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,  // VkDescriptorType                     TargetDescriptorType
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,          // VkDescriptorType                     TargetDescriptorType
         {                                           // std::vector<VkDescriptorBufferInfo>  BufferInfos
           {
-            modelUBuffers[0],                       // VkBuffer                             buffer
+            modelBuffers[0],                       // VkBuffer                             buffer
             0,                                      // VkDeviceSize                         offset
             VK_WHOLE_SIZE                           // VkDeviceSize                         range
           }
@@ -827,7 +1086,8 @@ bool ComputeApp::setupFrameResources()
 
 bool ComputeApp::setupChunkManager()
 {
-  chunkManager = std::make_unique<ChunkManager>(registry.get(), &registryMutex, &allocator, &*vulkanDevice);
+  chunkManager = std::make_unique<ChunkManager>(registry.get(), &registryMutex, &allocator, &*vulkanDevice, volumePool.get(), chunkBuffers.get(), &columnOccupancy, &chunkTable);
+  chunkManager->setCacheBudget(chunkCacheBudget);
 
   return true;
 }
@@ -843,7 +1103,8 @@ bool ComputeApp::setupTerrainGenerator()
 
 bool ComputeApp::setupSurfaceExtractor()
 {
-  surfaceExtractor = std::make_unique<SurfaceExtractor>(&*vulkanDevice, &transferQueue, &transferQMutex, commandPools.get());
+  surfaceExtractor = std::make_unique<SurfaceExtractor>(&*vulkanDevice, &transferQueue, &transferQMutex, commandPools.get(), chunkBuffers.get(), &chunkTable);
+  uploadBatcher = std::make_unique<UploadBatcher>(&*vulkanDevice, &allocator, &transferQueue, &transferQMutex, graphicsQueueParameters.familyIndex, StagingRingBytes);
 
   return true;
 }
@@ -856,6 +1117,13 @@ bool ComputeApp::setupECS()
   return true;
 }
 
+bool ComputeApp::setupVolumePool()
+{
+  volumePool = std::make_unique<VolumePool>(VolumesPerSlab, MaxVolumeSlabs, InitialVolumeSlabs, UseHugePagesForVolumes);
+
+  return volumePool->capacity() > 0;
+}
+
 void ComputeApp::shutdownVulkanMemoryAllocator()
 {
   if (allocator)
@@ -873,6 +1141,10 @@ void ComputeApp::shutdownVulkanMemoryAllocator()
 void ComputeApp::shutdownChunkManager()
 {
   chunkManager->clear();
+  uploadBatcher->destroy();
+  uploadBatcher.reset();
+  chunkBuffers->destroyAll();
+  chunkBuffers.reset();
 }
 
 void ComputeApp::shutdownGraphicsPipeline()
@@ -880,8 +1152,9 @@ void ComputeApp::shutdownGraphicsPipeline()
   for (int i = 0; i < 3; i++)
   {
     vmaDestroyBuffer(allocator, viewprojUBuffers[i], viewprojAllocs[i]);
-    vmaDestroyBuffer(allocator, modelUBuffers[i], modelAllocs[i]);
+    vmaDestroyBuffer(allocator, modelBuffers[i], modelAllocs[i]);
     vmaDestroyBuffer(allocator, lightUBuffers[i], lightAllocs[i]);
+    vmaDestroyBuffer(allocator, indirectBuffers[i], indirectAllocs[i]);
   }
 }
 
@@ -1041,6 +1314,10 @@ void ComputeApp::updateUser()
   }
 
   glm::vec3 pos = camera.GetPosition();
+  if (playingCameraPath)
+  {
+    pos = SampleCameraPath(cameraPath, gameTime);
+  }
   WrapCoordinates(pos);
   camera.SetPosition(pos);
 
@@ -1058,63 +1335,236 @@ void ComputeApp::updateUser()
 
 void ComputeApp::checkForNewChunks()
 {
-  static float despawnTimer = 0.f;
-  despawnTimer += TimerState.GetDeltaTime();
-  if (despawnTimer > 1.f)
-  {
-    VulkanInterface::WaitUntilAllCommandsSubmittedToQueueAreFinished(graphicsQueue); // Ouch
-    chunkManager->despawnChunks(camera.GetPosition());
-    despawnTimer = 0.f;
-  }
-  auto chunkList = chunkManager->getChunkSpawnList(camera.GetPosition());
-  for (auto & chunk : chunkList)
-  {    
-    if (chunk.second == ChunkManager::ChunkStatus::NotLoadedCached)
+  glm::vec3 cameraPos = camera.GetPosition();
+  // Only does work when the camera changes chunk, buffers of anything unloaded are retired
+  // to the ChunkBufferPool until the frames using them are done, so no queue wait
+  chunkManager->despawnChunks(cameraPos);
+  auto chunkList = chunkManager->getChunkSpawnList(cameraPos);
+  pendingChunkJobs += static_cast<uint32_t>(chunkList.size());
+  spawnBacklogPeak = std::max(spawnBacklogPeak, chunkManager->getSpawnBacklog());
+  despawnBacklogPeak = std::max(despawnBacklogPeak, chunkManager->getDespawnBacklog());
+
+  // Moving more than a chunk at once (including the first update) is a teleport
+  ChunkCoord cameraChunk = chunkCoordFromWorld(cameraPos);
+  ChunkCoord moved = toroidalChunkDelta(lastCameraChunk, cameraChunk);
+  if (!chunkList.empty() && (!lastCameraChunkValid || std::abs(moved.x) > 1 || std::abs(moved.y) > 1 || std::abs(moved.z) > 1))
+  {
+    beginTimeToVisible(chunkList);
+  }
+  lastCameraChunk = cameraChunk;
+  lastCameraChunkValid = true;
+
+  if (!chunkList.empty())
+  {
+    std::vector<glm::vec3> positions;
+    std::vector<CancelToken> tokens;
+    positions.reserve(chunkList.size());
+    tokens.reserve(chunkList.size());
+    for (auto & chunk : chunkList)
     {
-      if (logging)
-      {
-        tp registered = hr_clock::now();
-        computeTaskflow->emplace([=, &logFile = logFile]() {
-          logEntryData data;
-          data.registered = registered;         
+      ChunkRecord const & record = chunkTable.get(chunk.first); // Only the fixed members, no job can have it yet
+      positions.push_back(record.pos);
+      tokens.push_back(record.cancel);
+    }
 
-          loadFromChunkCache(chunk.first, data);
+    tp registered = hr_clock::now();
+    for (size_t i = 0; i < chunkList.size(); i++)
+    {
+      ChunkJob job = {
+        chunkList[i].first,
+        chunkList[i].second == ChunkManager::ChunkStatus::NotLoadedCached,
+        positions[i],
+        terrainGen->surfaceHeight(positions[i]),
+        0.f,
+        registered,
+        tokens[i]
+      };
+      chunkScheduler.push(job);
+    }
+  }
 
-          data.end = hr_clock::now();
-          insertEntry(logFile, data);
-        });
-      }
-      else
-      {
-        computeTaskflow->emplace([=]() {
-          loadFromChunkCache(chunk.first);
-        });
-      }
+  {
+    // Builds which couldn't get a volume slot or upload, they wait their turn again with everything else
+    std::lock_guard<std::mutex> lock(deferredChunkJobsMutex);
+    for (auto const & job : deferredChunkJobs)
+    {
+      chunkScheduler.push(job);
     }
-    else if (chunk.second == ChunkManager::ChunkStatus::NotLoadedNotCached)
-    { 
-      if (logging)
-      {
-        tp registered = hr_clock::now();
-        computeTaskflow->emplace([=, &logFile = logFile]() {
-          logEntryData data;
-          data.registered = registered;
+    deferredChunkJobs.clear();
+  }
+
+  // Only hand out enough work to keep the workers busy, the rest waits so it can be
+  // re-prioritised as the camera moves. Starts are capped per update too, so a burst
+  // of spawns doesn't turn into a burst of uploads fighting over the transfer queue
+  chunkScheduler.updatePriorities(cameraPos, frustumBuilt ? &frustum : nullptr);
+  uint32_t maxInFlight = computeExecutor->numWorkers() * ChunkJobsInFlightPerWorker;
+  uint32_t inFlight = chunkJobsInFlight;
+  if (inFlight < maxInFlight)
+  {
+    std::vector<ChunkJob> jobs;
+    chunkScheduler.pop(std::min(maxInFlight - inFlight, MaxChunkJobsStartedPerUpdate), jobs);
+    for (auto const & job : jobs)
+    {
+      dispatchChunkJob(job);
+    }
+  }
+  chunkPipeline->dispatch();
 
-          generateChunk(chunk.first, data);
+  if (prefetching)
+  {
+    prefetchChunks();
+  }
+}
 
-          data.end = hr_clock::now();
-          insertEntry(logFile, data);
-        });
-      }
-      else
+void ComputeApp::dispatchChunkJob(ChunkJob const & job)
+{
+  if (job.cancel.cancelled()) // Left range while it was queued, nothing's been done for it yet
+  {
+    finishChunkJob(job, false);
+    return;
+  }
+
+  chunkJobsInFlight++;
+  auto build = std::make_unique<ChunkBuild>();
+  build->job = job;
+  build->logData.registered = job.registered;
+  chunkPipeline->push(std::move(build));
+}
+
+void ComputeApp::finishBuild(ChunkBuild & build)
+{
+  if (logging)
+  {
+    build.logData.end = hr_clock::now();
+    if (!build.completed)
+    {
+      // Partial timings aren't comparable with anything, leave them out
+    }
+    else if (build.logData.loadedFromCache)
+    {
+      insertCacheHitEntry(cacheHitLogFile, build.logData);
+    }
+    else
+    {
+      insertEntry(logFile, build.logData);
+    }
+  }
+  chunkJobsInFlight--;
+  if (build.deferred && !build.job.cancel.cancelled())
+  {
+    // Still wanted, it's only been put off. Stays pending and isn't a cancellation
+    chunkJobsDeferred++;
+    std::lock_guard<std::mutex> lock(deferredChunkJobsMutex);
+    deferredChunkJobs.push_back(build.job);
+    return;
+  }
+  finishChunkJob(build.job, build.completed);
+}
+
+void ComputeApp::finishChunkJob(ChunkJob const & job, bool const completed)
+{
+  pendingChunkJobs--;
+  if (!completed)
+  {
+    chunkJobsCancelled++;
+  }
+  else
+  {
+    chunkJobsCompleted++;
+    if (job.cancel.cancelled())
+    {
+      chunkJobsWasted++; // Ran to completion for a chunk which had already left range
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(timeToVisibleMutex);
+  if (timeToVisibleWaiting.erase(job.handle) == 1 && timeToVisibleWaiting.empty())
+  {
+    timeToVisibleMs = duration_cast<nanoseconds>(hr_clock::now() - teleportTime).count() * 1e-6;
+    syncout() << "Nearest " << TimeToVisibleChunks << " chunks visible " << timeToVisibleMs << "ms after teleport\n";
+  }
+}
+
+void ComputeApp::beginTimeToVisible(std::vector<std::pair<EntityHandle, ChunkManager::ChunkStatus>> const & chunkList)
+{
+  // The spawn list is closest first
+  std::lock_guard<std::mutex> lock(timeToVisibleMutex);
+  timeToVisibleWaiting.clear();
+  for (size_t i = 0; i < chunkList.size() && i < TimeToVisibleChunks; i++)
+  {
+    timeToVisibleWaiting.insert(chunkList[i].first);
+  }
+  teleportTime = hr_clock::now();
+}
+
+void ComputeApp::buildColumnOccupancy()
+{
+  // A row of columns per task, as housekeeping so it fills in around the first chunk jobs
+  // rather than holding them up. Chunks spawned before their column is built are generated as usual
+  for (int32_t z = 0; z < static_cast<int32_t>(WorldDimension); z++)
+  {
+    computeExecutor->submit(TaskPriority::Housekeeping, [=]() {
+      for (int32_t x = 0; x < static_cast<int32_t>(WorldDimension); x++)
       {
-        computeTaskflow->emplace([=]() {
-          generateChunk(chunk.first);
-        });
+        columnOccupancy.buildColumn(*terrainGen, x, z);
       }
-    }
+    });
   }
-  computeTaskflow->dispatch();
+}
+
+void ComputeApp::prefetchChunks()
+{
+  prefetcher.recordPosition(gameTime, camera.GetPosition());
+
+  glm::vec3 predicted;
+  if (!prefetcher.predictPosition(PrefetchLookahead, predicted)) return;
+
+  uint32_t workers = computeExecutor->numWorkers();
+  uint32_t inFlight = static_cast<uint32_t>(chunkManager->getPrefetchesInFlight());
+  uint32_t busy = pendingChunkJobs + inFlight;
+  if (busy >= workers || inFlight >= PrefetchMaxInFlight) return;
+
+  uint32_t budget = std::min(workers - busy, PrefetchMaxInFlight - inFlight);
+  for (auto & chunk : chunkManager->getChunkPrefetchList(camera.GetPosition(), predicted, budget))
+  {
+    computeExecutor->submit(TaskPriority::Prefetch, [=]() {
+      prefetchChunk(chunk.first, chunk.second);
+    });
+  }
+}
+
+void ComputeApp::prefetchChunk(KeyType const key, glm::vec3 const pos)
+{
+  if (!ready) // Catch if we're about to shutdown
+  {
+    chunkManager->cancelPrefetch(key);
+    return;
+  }
+
+  // Not attached to a chunk yet, so the slot comes straight from the pool
+  VolumeHandle volume = volumePool->acquire();
+  if (volume == InvalidVolumeHandle)
+  {
+    chunkManager->cancelPrefetch(key);
+    return;
+  }
+  terrainGen->getChunkVolume(pos, volumePool->get(volume));
+
+  ChunkCacheData data;
+  if (CacheMeshes)
+  {
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+    surfaceExtractor->buildMesh(volumePool->get(volume), vertices, indices);
+    encodeMesh(vertices, indices, data.mesh);
+  }
+  if (!CacheMeshes || volumeResidency != VolumeResidency::Dropped)
+  {
+    compressVolume(volumePool->get(volume), data.volume);
+  }
+  volumePool->release(volume);
+
+  chunkManager->finishPrefetch(key, std::move(data));
 }
 
 void ComputeApp::getChunkRenderList()
@@ -1125,27 +1575,30 @@ void ComputeApp::getChunkRenderList()
   proj[1][1] *= -1; // Correct projection for vulkan
 
   frustum.Construct(screenDepth, proj, view);
+  frustumBuilt = true;
 
   chunkRenderList.clear();
-  chunkRenderList.reserve(256); // Revise size when frustum culling implemented
+  chunkRenderList.reserve(MaxRenderedChunks); // Revise size when frustum culling implemented
   int i = 0;
-  registryMutex.lock();
 
   // Sort chunks by world position so if we truncate the renderlist we preserve the closest chunks
   registry->sort<WorldPosition>([&](auto const & lhs, auto const & rhs) {
     return sqrdToroidalDistance(camera.GetPosition(), lhs.pos) < sqrdToroidalDistance(camera.GetPosition(), rhs.pos);
   });
 
-  registry->view<WorldPosition, VolumeData, ModelData, AABB>().each(
-    [=, &i=i, &registry=registry, &chunkRenderList=chunkRenderList, &camera=camera](const uint32_t entity, auto&&...)
+  registry->view<WorldPosition, AABB>().each(
+    [=, &i=i, &registry=registry, &chunkTable=chunkTable, &chunkRenderList=chunkRenderList, &camera=camera](const uint32_t entity, auto&&...)
     {
-      auto[pos, modelData] = registry->get<WorldPosition, ModelData>(entity);
+      // Chunks still being built belong to their workers
+      if (chunkTable.state(entity) != ChunkLifecycle::Resident) return;
+      auto & pos = registry->get<WorldPosition>(entity);
+      auto & modelData = chunkTable.get(entity).model;
 
       // Check if we need to shift chunk position by world dimension
       glm::vec3 chunkPos = pos.pos;
       CorrectChunkPosition(camera.GetPosition(), chunkPos);
 
-      if (modelData.indexCount > 0 && chunkIsWithinFrustum(entity) && chunkRenderList.size() < 256)
+      if (modelData.indexCount > 0 && chunkIsWithinFrustum(entity) && chunkRenderList.size() < MaxRenderedChunks)
       {
         chunkRenderList.push_back(entity);
 
@@ -1160,12 +1613,11 @@ void ComputeApp::getChunkRenderList()
         PerChunkData data = {
           model
         };
-        memcpy(&chunkDataPtr[i*dynamicAlignment], &data, sizeof(PerChunkData));
-        i++; // Move to next aligned position
+        memcpy(&chunkDataPtr[i*sizeof(PerChunkData)], &data, sizeof(PerChunkData));
+        i++; // The chunk's draw uses i as its instance to find this
       }      
     }
   );
-  registryMutex.unlock();
 
   vmaFlushAllocation(allocator, modelAllocs[nextFrameIndex], 0, VK_WHOLE_SIZE);
 
@@ -1186,10 +1638,10 @@ void ComputeApp::getChunkRenderList()
       descriptorSets[nextFrameIndex],             // VkDescriptorSet                      TargetDescriptorSet
       1,                                          // uint32_t                             TargetDescriptorBinding
       0,                                          // uint32_t                             TargetArrayElement
-      VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,  // VkDescriptorType                     TargetDescriptorType
+      VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,          // VkDescriptorType                     TargetDescriptorType
       {                                           // std::vector<VkDescriptorBufferInfo>  BufferInfos
         {
-          modelUBuffers[nextFrameIndex],          // VkBuffer                             buffer
+          modelBuffers[nextFrameIndex],          // VkBuffer                             buffer
           0,                                      // VkDeviceSize                         offset
           VK_WHOLE_SIZE                           // VkDeviceSize                         range
         }
@@ -1215,6 +1667,11 @@ void ComputeApp::getChunkRenderList()
 
 bool ComputeApp::drawChunks()
 {
+  // Chunks whose uploads have landed go resident, then everything staged since the last
+  // frame goes to the transfer queue as one submission
+  uploadBatcher->collect();
+  uploadBatcher->flush();
+
   auto framePrep = [&](VkCommandBuffer commandBuffer, uint32_t imageIndex, VkFramebuffer framebuffer)
   {
     if (chunkRenderList.size() > 0)
@@ -1244,6 +1701,28 @@ bool ComputeApp::drawChunks()
         );
       }
 
+      // Before any draws read the meshes at their new offsets
+      defragmentChunkBuffers(commandBuffer);
+
+      // Every visible chunk's draw as numbers in the indirect buffer, built after defragmentation
+      // has settled where the meshes are. Each chunk's instance is its place in the render list,
+      // the same order getChunkRenderList wrote the model matrices in
+      tp const drawListStart = hr_clock::now();
+      chunkDrawList.clear();
+      for (uint32_t i = 0; i < chunkRenderList.size(); i++)
+      {
+        // Despawning happens before the render list is built, everything on it is still Resident
+        chunkDrawList.add(chunkTable.get(chunkRenderList[i]).model, i);
+      }
+      chunkDrawList.build();
+      auto const & drawCommands = chunkDrawList.getCommands();
+
+      VmaAllocationInfo indirectInfo;
+      vmaGetAllocationInfo(allocator, indirectAllocs[nextFrameIndex], &indirectInfo);
+      memcpy(indirectInfo.pMappedData, drawCommands.data(), drawCommands.size() * sizeof(VkDrawIndexedIndirectCommand));
+      vmaFlushAllocation(allocator, indirectAllocs[nextFrameIndex], 0, VK_WHOLE_SIZE);
+      chunkDrawListNs += duration_cast<nanoseconds>(hr_clock::now() - drawListStart).count();
+
       // Draw
       VulkanInterface::BeginRenderPass(commandBuffer, renderPass, framebuffer
         , { {0,0}, swapchain.size } // Render Area (full frame size)
@@ -1292,19 +1771,34 @@ bool ComputeApp::drawChunks()
       vmaUnmapMemory(allocator, viewprojAllocs[imageIndex]);
       vmaFlushAllocation(allocator, viewprojAllocs[imageIndex], 0, VK_WHOLE_SIZE);
 
-      for (int i = 0; i < chunkRenderList.size(); i++)
-      {        
-        registryMutex.lock();
-        ModelData modelData = registry->get<ModelData>(chunkRenderList[i]);           
+      // Model matrices are found by instance, one binding covers every draw
+      VulkanInterface::BindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipelineLayout, 0, { descriptorSets[imageIndex] }, {});
 
-        uint32_t dynamicOffset = i * static_cast<uint32_t>(dynamicAlignment);
-        VulkanInterface::BindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipelineLayout, 0, { descriptorSets[imageIndex] }, { dynamicOffset });
-
-        VulkanInterface::BindVertexBuffers(commandBuffer, 0, { {modelData.vertexBuffer, 0} });
-        VulkanInterface::BindIndexBuffer(commandBuffer, modelData.indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+      // Chunks share the pages of the chunk buffer pool, one indirect draw for each pair of pages used
+      for (auto const & batch : chunkDrawList.getBatches())
+      {
+        VulkanInterface::BindVertexBuffers(commandBuffer, 0, { {batch.vertexBuffer, 0} });
+        VulkanInterface::BindIndexBuffer(commandBuffer, batch.indexBuffer, 0, VK_INDEX_TYPE_UINT32);
 
-        VulkanInterface::DrawIndexedGeometry(commandBuffer, modelData.indexCount, 1, 0, 0, 0);
-        registryMutex.unlock();
+        if (multiDrawIndirect)
+        {
+          VulkanInterface::DrawIndexedGeometryIndirect(commandBuffer
+            , indirectBuffers[nextFrameIndex]
+            , batch.firstCommand * sizeof(VkDrawIndexedIndirectCommand)
+            , batch.commandCount
+            , sizeof(VkDrawIndexedIndirectCommand));
+          chunkDrawCalls++;
+        }
+        else
+        {
+          // Same commands, recorded one at a time
+          for (uint32_t c = batch.firstCommand; c < batch.firstCommand + batch.commandCount; c++)
+          {
+            auto const & command = drawCommands[c];
+            VulkanInterface::DrawIndexedGeometry(commandBuffer, command.indexCount, command.instanceCount, command.firstIndex, static_cast<uint32_t>(command.vertexOffset), command.firstInstance);
+          }
+          chunkDrawCalls += batch.commandCount;
+        }
       }
 
       VulkanInterface::EndRenderPass(commandBuffer);
@@ -1349,7 +1843,7 @@ bool ComputeApp::drawChunks()
     lightData.lightSpecularColour = glm::vec3(1.f, 1.f, 1.f);
     lightData.objectColour = glm::vec3(1.f, 0.0f, 1.0f);
 
-    auto[mutex, transferCmdBuf] = commandPools->transferPools.getBuffer(nextFrameIndex);
+    auto transfer = commandPools->transferPools.getBuffer(nextFrameIndex);
 
     // Technically only required once with static data, but if the lighting data were dynamic this makes sense
     if (!VulkanInterface::UseStagingBufferToUpdateBufferWithDeviceLocalMemoryBound(
@@ -1365,13 +1859,15 @@ bool ComputeApp::drawChunks()
       , VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT
       , transferQueue
       , &transferQMutex
-      , *transferCmdBuf
+      , *transfer.buffer
       , {}))
     {
-      mutex->unlock();
       return false;
     }
-    mutex->unlock();
+    if (transfer.lock.owns_lock())
+    {
+      transfer.lock.unlock(); // Done with the shared command buffer, don't hold it through the frame
+    }
 
     static uint32_t frameIndex = 0;
     FrameResources & currentFrame = frameResources[frameIndex];
@@ -1381,6 +1877,8 @@ bool ComputeApp::drawChunks()
       return false;
     }
 
+    collectChunkBuffers();
+
     if (!VulkanInterface::ResetFences(*vulkanDevice, { *currentFrame.drawingFinishedFence }))
     {
       return false;
@@ -1402,6 +1900,7 @@ bool ComputeApp::drawChunks()
       return false;
     }
 
+    chunkBuffers->frameSubmitted(frameIndex);
     frameIndex = (frameIndex + 1) % frameResources.size();
     nextFrameIndex = frameIndex;
 
@@ -1410,10 +1909,68 @@ bool ComputeApp::drawChunks()
   else
   {
     //mutex->unlock();
+    collectChunkBuffers(); // Frames still in flight may finish with buffers of chunks that have since gone
     return true;
   }
 }
 
+void ComputeApp::collectChunkBuffers()
+{
+  std::vector<VkFence> fences;
+  fences.reserve(frameResources.size());
+  for (auto & frameRes : frameResources)
+  {
+    fences.push_back(*frameRes.drawingFinishedFence);
+  }
+  chunkBuffers->collect(fences);
+}
+
+void ComputeApp::defragmentChunkBuffers(VkCommandBuffer commandBuffer)
+{
+  std::vector<ChunkBufferMove> moves = chunkBuffers->planMoves(ChunkBufferMovesPerFrame, ChunkBufferDefragThreshold);
+  if (moves.empty()) return;
+
+  std::vector<VulkanInterface::BufferTransition> transitions;
+  for (auto const & move : moves)
+  {
+    // Only Resident chunks belong to this thread, anything else is left where it is
+    EntityHandle handle = move.key;
+    if (chunkTable.state(handle) != ChunkLifecycle::Resident)
+    {
+      chunkBuffers->cancelMove(move);
+      continue;
+    }
+    ModelData & model = chunkTable.get(handle).model;
+    ChunkBufferRange & range = move.usage == ChunkBufferUsage::Vertex ? model.vertices : model.indices;
+    if (range.page != move.from.page || range.block != move.from.block)
+    {
+      chunkBuffers->cancelMove(move);
+      continue;
+    }
+
+    VkDeviceSize const elementSize = ChunkBufferPool::elementSize(move.usage);
+    VulkanInterface::CopyDataBetweenBuffers(commandBuffer, move.buffer, move.buffer, { { elementSize * move.from.offset, elementSize * move.to.offset, elementSize * move.from.count } });
+    range = move.to;
+    chunkBuffers->commitMove(move);
+    VulkanInterface::AddChunkBufferReadTransition(transitions, move.buffer);
+  }
+  if (!transitions.empty())
+  {
+    VulkanInterface::SetBufferMemoryBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, transitions);
+  }
+}
+
+void ComputeApp::finishComputeWork()
+{
+  // Workers can be blocked on ring space only a flush and collect will free
+  while (!computeExecutor->waitFor(microseconds(1000)))
+  {
+    uploadBatcher->flush();
+    uploadBatcher->collect();
+  }
+  uploadBatcher->drain(); // Builds still waiting on their batch
+}
+
 bool ComputeApp::chunkIsWithinFrustum(uint32_t const entity)
 {
   auto[pos, aabb] = registry->get<WorldPosition, AABB>(entity);
@@ -1422,150 +1979,306 @@ bool ComputeApp::chunkIsWithinFrustum(uint32_t const entity)
   return frustum.CheckCube(chunkPos, 32) || frustum.CheckCube(chunkPos, 16); // Oversized aabb for frustum check
 }
 
-void ComputeApp::loadFromChunkCache(EntityHandle handle)
+BuildStage ComputeApp::noiseStage(ChunkBuild & build)
 {
-  registryMutex.lock();
-  glm::vec3 pos;
-  if (registry->valid(handle)) // Verify handle is still valid
+  EntityHandle handle = build.job.handle;
+  if (!ready || build.job.cancel.cancelled()) return abandonBuild(build); // Catch if we're about to shutdown
+  if (!claimChunk(handle)) return abandonBuild(build); // Unloaded before we got to it
+  build.claimed = true;
+
+  ChunkRecord & chunk = chunkTable.get(handle);
+  logEntryData & logData = build.logData;
+  logData.start = hr_clock::now();
+  logData.key = chunkKey(chunkCoordFromWorld(chunk.pos));
+
+  BuildStage next;
+  if (build.job.cached && restoreFromCache(build, next))
   {
-    pos = registry->get<WorldPosition>(handle).pos;
+    return next;
   }
-  else
+  // Not cached or it's fallen out of the cache since it was spawned, generate it
+
+  build.volume = beginVolumeWork(handle);
+  if (build.volume == InvalidVolumeHandle) return deferBuild(build);
+
+  logData.loadedFromCache = false;
+  if (!terrainGen->getChunkVolume(chunk.pos, volumePool->get(build.volume), logData, &build.job.cancel))
   {
-    registryMutex.unlock();
-    return;
+    return abandonBuild(build);
   }
-  registryMutex.unlock();
-  ChunkCacheData data;
-  if (chunkManager->getChunkVolumeDataFromCache(chunkManager->chunkKey(pos), data)) // Retrieve data from cache
+  return BuildStage::Mesh;
+}
+
+BuildStage ComputeApp::meshStage(ChunkBuild & build)
+{
+  if (build.job.cancel.cancelled()) return abandonBuild(build);
+
+  chunkTable.advance(build.job.handle, ChunkLifecycle::Meshing);
+  build.logData.surfaceStart = hr_clock::now();
+  surfaceExtractor->buildTris(volumePool->get(build.volume), build.generatedVerts, build.generatedIndices);
+  return BuildStage::Optimise;
+}
+
+BuildStage ComputeApp::optimiseStage(ChunkBuild & build)
+{
+  if (build.job.cancel.cancelled()) return abandonBuild(build);
+
+  bool surface = surfaceExtractor->optimiseMesh(build.generatedVerts, build.generatedIndices, build.vertices, build.indices);
+  std::vector<Vertex>().swap(build.generatedVerts);
+  std::vector<dualmc::TriIndexType>().swap(build.generatedIndices);
+  if (!surface)
   {
-    registryMutex.lock();
-    auto & volume = registry->get<VolumeData>(handle);
-    volume.volume = data;
-    registryMutex.unlock();
+    surfaceExtractor->clearModel(build.job.handle);
+    if (CacheMeshes)
+    {
+      encodeMesh(build.vertices, build.indices, build.encoded); // Remember there's nothing here
+    }
+    return completeBuild(build);
+  }
+  return BuildStage::Normals;
+}
 
-    surfaceExtractor->extractSurface(handle, registry.get(), &registryMutex, nextFrameIndex);
+BuildStage ComputeApp::normalsStage(ChunkBuild & build)
+{
+  if (build.job.cancel.cancelled()) return abandonBuild(build);
 
-    registryMutex.lock();
-    auto & model = registry->get<ModelData>(handle);
-    syncout() << handle << " generated, " << model.indexCount / 3 << " triangles\n";
-    registryMutex.unlock();
+  surfaceExtractor->computeNormals(build.vertices, build.indices);
+  // Keep an encoded copy so the chunk can skip meshing entirely if it's reloaded from the cache
+  if (CacheMeshes)
+  {
+    encodeMesh(build.vertices, build.indices, build.encoded);
   }
-  else // Chunk has fallen out of the cache
+  return BuildStage::Upload;
+}
+
+BuildStage ComputeApp::uploadStage(ChunkBuild & build)
+{
+  if (build.job.cancel.cancelled()) return abandonBuild(build); // Last chance before committing GPU memory
+
+  // Staged into the ring, the model is committed on the main thread once its batch has been copied.
+  // Whichever of that and this worker finishes second publishes the chunk
+  ChunkBuild * staged = &build;
+  if (surfaceExtractor->stageMesh(build.job.handle, build.vertices, build.indices, *uploadBatcher, [this, staged]() {
+      if (staged->uploadHandoff.exchange(true)) publishStagedBuild(*staged);
+    }))
+  {
+    // The ring has its own copy of the mesh. Compress the volume and hand back the cache's data
+    // here rather than on the main thread, and free the volume slot without waiting on the GPU
+    handBackBuild(build);
+    if (build.uploadHandoff.exchange(true)) publishStagedBuild(build); // The batch beat us, don't touch build after this
+    return BuildStage::Detached;
+  }
+
+  // Too big for the ring, stage it on its own and wait
+  tp start = hr_clock::now();
+  bool uploaded = surfaceExtractor->uploadMesh(build.job.handle, nextFrameIndex, build.vertices, build.indices);
+  uploadsDirect++;
+  uploadDirectUs += duration_cast<microseconds>(hr_clock::now() - start).count();
+  if (!uploaded)
   {
-    generateChunk(handle);
+    return deferBuild(build); // Couldn't get buffers or stage it, publishing now would leave the chunk with nothing to draw
   }
+  return completeBuild(build);
 }
 
-void ComputeApp::generateChunk(EntityHandle handle)
+void ComputeApp::publishStagedBuild(ChunkBuild & build)
 {
-  if (!ready) return; // Catch if we're about to shutdown
-  if (!registry->valid(handle)) return; // Chunk has been unloaded
-  else
+  publishBuild(build);
+  chunkPipeline->resume(std::unique_ptr<ChunkBuild>(&build), BuildStage::Finished);
+}
+
+bool ComputeApp::restoreFromCache(ChunkBuild & build, BuildStage & next)
+{
+  EntityHandle handle = build.job.handle;
+  ChunkCacheData & data = build.cached;
+  if (!chunkManager->getChunkDataFromCache(build.logData.key, data))
   {
-    registry->get<VolumeData>(handle).generating = true; // Mark volume as generating to stop it being unloaded during generation
+    return false;
   }
 
-  //std::cout << handle << std::endl;
-  auto pos = registry->get<WorldPosition>(handle);
-  ChunkCacheData data = terrainGen->getChunkVolume(pos.pos);
-  registryMutex.lock();
+  // Only claim a volume slot if we have to re-mesh or volumes are meant to stay resident
+  bool needsVolume = !data.mesh.built || volumeResidency == VolumeResidency::Resident;
+  if (needsVolume && data.volume.empty())
   {
-    auto & volume = registry->get<VolumeData>(handle);
-    volume.volume = data;
+    data = ChunkCacheData();
+    return false; // Nothing to build from, has to be generated again
+  }
+  build.restored = true;
+  build.logData.loadedFromCache = true;
+  build.logData.meshFromCache = data.mesh.built;
+
+  if (needsVolume)
+  {
+    build.volume = beginVolumeWork(handle);
+    if (build.volume == InvalidVolumeHandle)
+    {
+      next = deferBuild(build);
+      return true;
+    }
+    decompressVolume(data.volume, volumePool->get(build.volume));
   }
-  registryMutex.unlock();
 
-  surfaceExtractor->extractSurface(handle, registry.get(), &registryMutex, nextFrameIndex);
+  if (!data.mesh.built)
+  {
+    next = BuildStage::Mesh;
+    return true;
+  }
 
-  registryMutex.lock();
+  // Decoding is cheap enough to do here, the mesh goes straight to the upload
+  build.logData.surfaceStart = hr_clock::now();
+  if (!decodeMesh(data.mesh, build.vertices, build.indices) || build.indices.empty())
   {
-    auto[model, volume] = registry->get<ModelData, VolumeData>(handle);
-    volume.generating = false;
-    syncout() << handle << " generated, " << model.indexCount / 3 << " triangles\n";
+    surfaceExtractor->clearModel(handle);
+    next = completeBuild(build);
+    return true;
   }
-  registryMutex.unlock();
+  next = BuildStage::Upload;
+  return true;
 }
 
-void ComputeApp::loadFromChunkCache(EntityHandle handle, logEntryData & logData)
+BuildStage ComputeApp::completeBuild(ChunkBuild & build)
 {
-  registryMutex.lock();
-  glm::vec3 pos;
-  if (registry->valid(handle)) // Verify handle is still valid
+  handBackBuild(build);
+  return publishBuild(build);
+}
+
+void ComputeApp::handBackBuild(ChunkBuild & build)
+{
+  EntityHandle handle = build.job.handle;
+  ChunkRecord & chunk = chunkTable.get(handle);
+
+  // Hand the encoded data back to the chunk so it can be cached again when it unloads
+  if (build.restored && build.cached.mesh.built)
   {
-    pos = registry->get<WorldPosition>(handle).pos;
-    logData.key = chunkManager->chunkKey(pos);
+    chunk.mesh.mesh = std::move(build.cached.mesh);
   }
-  else
+  else if (build.encoded.built)
   {
-    registryMutex.unlock();
-    return;
+    chunk.mesh.mesh = std::move(build.encoded);
   }
-  registryMutex.unlock();
-  ChunkCacheData data;
-  if (chunkManager->getChunkVolumeDataFromCache(chunkManager->chunkKey(pos), data)) // Retrieve data from cache
-  {
-    registryMutex.lock();
-    auto & volume = registry->get<VolumeData>(handle);
-    volume.volume = data;
-    registryMutex.unlock();
 
-    surfaceExtractor->extractSurface(handle, registry.get(), &registryMutex, nextFrameIndex);
+  if (build.volume != InvalidVolumeHandle)
+  {
+    finishVolumeWork(handle, build.volume);
+    build.volume = InvalidVolumeHandle;
+  }
+  else if (build.restored)
+  {
+    chunk.volume.compressed = std::move(build.cached.volume);
+  }
+}
 
-    registryMutex.lock();
-    auto & model = registry->get<ModelData>(handle);
-    syncout() << handle << " generated, " << model.indexCount / 3 << " triangles\n";
-    registryMutex.unlock();
+BuildStage ComputeApp::publishBuild(ChunkBuild & build)
+{
+  EntityHandle handle = build.job.handle;
+  ChunkRecord & chunk = chunkTable.get(handle);
+  build.logData.surfaceEnd = hr_clock::now();
+
+  syncout() << handle << (build.restored ? " restored, " : " generated, ") << chunk.model.indexCount / 3 << " triangles\n";
+  publishChunk(handle);
+  build.completed = true;
+  return BuildStage::Finished;
+}
 
-    logData.loadedFromCache = true;
+BuildStage ComputeApp::abandonBuild(ChunkBuild & build)
+{
+  if (build.volume != InvalidVolumeHandle)
+  {
+    abandonVolumeWork(build.job.handle, build.volume);
   }
-  else // Chunk has fallen out of the cache
+  else if (build.claimed)
   {
-    generateChunk(handle, logData);
+    releaseChunk(build.job.handle);
   }
-}
 
-void ComputeApp::generateChunk(EntityHandle handle, logEntryData & logData)
-{ 
-  if (!ready) return; // Catch if we're about to shutdown
-  if (!registry->valid(handle)) return; // Chunk has been unloaded
-  else
+  // The cached data goes back where it came from so nothing is lost
+  if (build.restored)
   {
-    registry->get<VolumeData>(handle).generating = true; // Mark volume as generating to stop it being unloaded during generation
+    chunkManager->returnToCache(build.logData.key, std::move(build.cached));
   }
+  build.completed = false;
+  return BuildStage::Finished;
+}
 
-  logData.start = hr_clock::now();
-  logData.loadedFromCache = false;
+BuildStage ComputeApp::deferBuild(ChunkBuild & build)
+{
+  build.deferred = true;
+  return abandonBuild(build);
+}
+
+bool ComputeApp::claimChunk(EntityHandle handle)
+{
+  return chunkTable.transition(handle, ChunkLifecycle::Queued, ChunkLifecycle::Generating);
+}
+
+void ComputeApp::publishChunk(EntityHandle handle)
+{
+  chunkTable.advance(handle, ChunkLifecycle::Resident);
+}
+
+void ComputeApp::releaseChunk(EntityHandle handle)
+{
+  chunkTable.advance(handle, ChunkLifecycle::Queued);
+}
 
-  //std::cout << handle << std::endl;
-  auto pos = registry->get<WorldPosition>(handle);
-  logData.key = chunkManager->chunkKey(pos.pos);
-  ChunkCacheData data = terrainGen->getChunkVolume(pos.pos, logData);
-  registryMutex.lock();
+VolumeHandle ComputeApp::beginVolumeWork(EntityHandle handle)
+{
+  auto & volumeData = chunkTable.get(handle).volume;
+  if (volumeData.volume == InvalidVolumeHandle)
   {
-    auto & volume = registry->get<VolumeData>(handle);
-    volume.volume = data;
+    volumeData.volume = volumePool->acquire();
+    if (volumeData.volume == InvalidVolumeHandle)
+    {
+      syncout() << "Volume pool exhausted, " << handle << " will not be generated\n";
+      return InvalidVolumeHandle;
+    }
   }
-  registryMutex.unlock();
 
-  logData.surfaceStart = hr_clock::now();
-  surfaceExtractor->extractSurface(handle, registry.get(), &registryMutex, nextFrameIndex);
-  logData.surfaceEnd = hr_clock::now();
+  return volumeData.volume;
+}
+
+void ComputeApp::finishVolumeWork(EntityHandle handle, VolumeHandle volume)
+{
+  if (volumeResidency == VolumeResidency::Resident) return;
 
-  registryMutex.lock();
+  CompressedVolume compressed;
+  if (volumeResidency == VolumeResidency::Compressed)
   {
-    auto[model, volume] = registry->get<ModelData, VolumeData>(handle);
-    volume.generating = false;
-    syncout() << handle << " generated, " << model.indexCount / 3 << " triangles\n";
+    compressVolume(volumePool->get(volume), compressed);
   }
-  registryMutex.unlock();
+
+  auto & volumeData = chunkTable.get(handle).volume;
+  volumeData.compressed = std::move(compressed);
+  volumeData.volume = InvalidVolumeHandle;
+  volumePool->release(volume);
+}
+
+void ComputeApp::abandonVolumeWork(EntityHandle handle, VolumeHandle volume)
+{
+  auto & volumeData = chunkTable.get(handle).volume;
+  volumeData.volume = InvalidVolumeHandle;
+  volumePool->release(volume);
+  releaseChunk(handle);
 }
 
 void ComputeApp::Shutdown()
 {
   if (ready)
   {
-    computeTaskflow->wait_for_all();
+    uint64_t spawned = chunkManager->getChunksSpawned(), knownEmpty = chunkManager->getKnownEmptyChunks();
+    if (spawned + knownEmpty > 0)
+    {
+      syncout() << "Spawned " << spawned << " chunk entities, skipped " << knownEmpty << " known empty ("
+        << (100.0 * knownEmpty) / (spawned + knownEmpty) << "% fewer)" << std::endl;
+    }
+    if (gameTime > 0.0)
+    {
+      syncout() << "Thread topology " << threadTopology.name() << ": " << chunkJobsCompleted.load() << " chunks built, "
+        << chunkJobsCompleted.load() / gameTime << " per second" << std::endl;
+    }
+
+    finishComputeWork();
+    chunkPipeline->clear();
     VulkanInterface::WaitForAllSubmittedCommandsToBeFinished(*vulkanDevice);
 
     // We can shutdown some systems in parallel since they don't depend on each other
@@ -1576,13 +2289,23 @@ void ComputeApp::Shutdown()
       [&]() { shutdownGraphicsPipeline(); }
     );
 
+    if (recordingCameraPath)
+    {
+      cameraPathFile.close();
+    }
+
     tf::Task saveLogFile;
     if (logging)
     {
       systemTaskflow->emplace(
-        [=, &logFile=logFile, &computeTaskflow=computeTaskflow]() {
-          computeTaskflow->wait_for_all();
+        [=, &logFile=logFile, &computeExecutor=computeExecutor]() {
+          computeExecutor->waitForAll();
           logFile.close();
+          countersLogFile.close();
+          cacheHitLogFile.close();
+          std::ofstream frameTimesLogFile = createLogFile("FrameTimes_" + threadTopology.name()); // Compare topologies side by side
+          frameTimes.write(frameTimesLogFile);
+          frameTimesLogFile.close();
         }
       );
     }
@@ -10,8 +10,17 @@
 #include "TaskflowCommandPools.hpp"
 #include "FrustumClass.hpp"
 #include "metrics.hpp"
+#include "ChunkPrefetcher.hpp"
+#include "CameraPath.hpp"
+#include "ChunkScheduler.hpp"
+#include "ChunkPipeline.hpp"
+#include "PriorityExecutor.hpp"
+#include "ThreadTopology.hpp"
+#include "UploadBatcher.hpp"
+#include "IndirectDrawList.hpp"
 
 #include <stack>
+#include <unordered_set>
 #include <array>
 
 class ComputeApp : public AppBase
@@ -19,6 +28,14 @@ class ComputeApp : public AppBase
 public:
   bool Initialise(VulkanInterface::WindowParameters windowParameters) override;
   bool InitMetrics();
+  bool InitCameraPathRecording();
+  // Drives the camera along a path recorded with -recordCameraPath instead of the user's input
+  bool InitCameraPathPlayback(std::string const & filename);
+  void SetPrefetching(bool const enabled);
+  // Only before initialisation
+  void SetThreadTopology(ThreadTopologyConfig const & config);
+  // Only safe to call before initialisation or from the update thread
+  void SetChunkCacheBudget(size_t const budgetBytes);
   bool Update() override;
   bool Resize() override;
 
@@ -36,6 +53,8 @@ private:
   bool setupTerrainGenerator();
   bool setupSurfaceExtractor();
   bool setupECS();
+  bool setupVolumePool();
+  void setupChunkPipeline();
 
   void Shutdown() override;
   void shutdownVulkanMemoryAllocator();
@@ -46,26 +65,92 @@ private:
   // App logic
   void updateUser();
   void checkForNewChunks();
+  // Queues building every column of columnOccupancy for the current seed
+  void buildColumnOccupancy();
   void getChunkRenderList();
   bool drawChunks();
+  // Frees chunk buffers retired before any frame whose fence has signalled, doesn't wait
+  void collectChunkBuffers();
+  // Records copies moving chunk meshes down fragmented chunk buffer pages, into the frame's
+  // command buffer before the render pass
+  void defragmentChunkBuffers(VkCommandBuffer commandBuffer);
+  // Waits for the executor while keeping uploads moving, then for every staged upload to
+  // finish. Main thread, nothing may submit chunk work meanwhile
+  void finishComputeWork();
 
   bool chunkIsWithinFrustum(uint32_t const entity);
-  void loadFromChunkCache(EntityHandle handle);
-  void generateChunk(EntityHandle handle);
-  void loadFromChunkCache(EntityHandle handle, logEntryData & logData);
-  void generateChunk(EntityHandle handle, logEntryData & logData);
+  // Queues the job's build on chunkPipeline
+  void dispatchChunkJob(ChunkJob const & job);
+  // Pipeline's finish function, logs the build's timings
+  void finishBuild(ChunkBuild & build);
+  void finishChunkJob(ChunkJob const & job, bool const completed);
+  // Starts timing how long the nearest TimeToVisibleChunks of a teleport's spawn list take to build
+  void beginTimeToVisible(std::vector<std::pair<EntityHandle, ChunkManager::ChunkStatus>> const & chunkList);
+  // Issues low priority prefetch jobs along the camera's predicted path, only onto workers
+  // the chunks we actually need aren't using
+  void prefetchChunks();
+  void prefetchChunk(KeyType const key, glm::vec3 const pos);
+
+  // Chunk build stages, each returns the stage the build goes to next. Any stage can
+  // finish a build early, abandoned if it was cancelled or completed if there's nothing to draw
+  BuildStage noiseStage(ChunkBuild & build);
+  BuildStage meshStage(ChunkBuild & build);
+  BuildStage optimiseStage(ChunkBuild & build);
+  BuildStage normalsStage(ChunkBuild & build);
+  BuildStage uploadStage(ChunkBuild & build);
+  // Cache hit path of the noise stage, returns false if the chunk has to be generated after all
+  bool restoreFromCache(ChunkBuild & build, BuildStage & next);
+  // Hands what the build made to the chunk and publishes it
+  BuildStage completeBuild(ChunkBuild & build);
+  // The worker's half of completeBuild: the encoded mesh and the cache's data go to the chunk
+  // and the volume is compressed and its slot released. Nothing can be abandoned afterwards
+  void handBackBuild(ChunkBuild & build);
+  // The other half, once the chunk's model has been committed
+  BuildStage publishBuild(ChunkBuild & build);
+  // Publishes a build staged through the UploadBatcher and hands it back to the pipeline
+  void publishStagedBuild(ChunkBuild & build);
+  // Lets go of the chunk without keeping anything, cached data goes back to the cache
+  BuildStage abandonBuild(ChunkBuild & build);
+  // Abandons a build which ran out of volume slots or couldn't upload, finishBuild reschedules its job
+  BuildStage deferBuild(ChunkBuild & build);
+  // Takes a Queued chunk for this job, fails if it's been unloaded or another job has it
+  bool claimChunk(EntityHandle handle);
+  // Hands a claimed chunk back to the update thread, built and drawable
+  void publishChunk(EntityHandle handle);
+  // Hands a claimed chunk back to the update thread unbuilt, e.g. when its job was cancelled
+  void releaseChunk(EntityHandle handle);
+  // Claims a volume slot for the chunk, the job must own the chunk
+  VolumeHandle beginVolumeWork(EntityHandle handle);
+  // Applies volumeResidency now the chunk has been meshed, the job still owns the chunk afterwards
+  void finishVolumeWork(EntityHandle handle, VolumeHandle volume);
+  // Releases the slot of a cancelled job without keeping anything and releases the chunk
+  void abandonVolumeWork(EntityHandle handle, VolumeHandle volume);
 
   // Metrics
-  bool logging;
+  bool logging = false;
   std::ofstream logFile;
+  std::ofstream countersLogFile;
+  std::ofstream cacheHitLogFile;
+  FrameTimeHistogram frameTimes; // Written to its own log on shutdown
+  double frameTimeMaxMs = 0.0;   // Slowest frame since the last counters were logged
+  double frameTimeSumMs = 0.0, frameTimeSumSqMs = 0.0; // For the jitter since the last counters were logged
+  uint32_t frameTimeSamples = 0;
+  void logCounters();
+  bool recordingCameraPath = false;
+  std::ofstream cameraPathFile; // Replayable with -replayCachePolicies
+  bool playingCameraPath = false;
+  std::vector<CameraPathSample> cameraPath;
+
 
+  // Which cores the frame path and chunk workers run on
+  ThreadTopologyConfig threadTopologyConfig = { ReservedFrameCores, PinThreads, NumaLocalThreads };
+  ThreadTopology threadTopology;
 
-  // cpp-taskflow taskflows and shared executor
+  // cpp-taskflow taskflows
   std::unique_ptr<tf::Taskflow> updateTaskflow
-                              , graphicsTaskflow
-                              , computeTaskflow
                               , systemTaskflow;
-  std::shared_ptr<tf::Taskflow::Executor> tfExecutor;
+  // Chunk builds, prefetches and housekeeping, by priority
+  std::unique_ptr<PriorityExecutor> computeExecutor;
 
   // Vulkan Memory Allocator
   VmaAllocator allocator;
@@ -90,22 +175,55 @@ private:
   VkDescriptorSetLayout descriptorSetLayout;
   VkDescriptorPool descriptorPool;
   std::vector<VkDescriptorSet> descriptorSets;
-  std::vector<VkBuffer> viewprojUBuffers, modelUBuffers, lightUBuffers;
+  std::vector<VkBuffer> viewprojUBuffers, modelBuffers, lightUBuffers;
   std::vector<VmaAllocation> viewprojAllocs, modelAllocs, lightAllocs;
+  std::vector<VkBuffer> indirectBuffers; // Each frame's VkDrawIndexedIndirectCommands, always mapped
+  std::vector<VmaAllocation> indirectAllocs;
+  bool multiDrawIndirect = false; // Otherwise each indirect command is recorded as its own draw
 
   VkPipeline graphicsPipeline;
   VkPipelineLayout graphicsPipelineLayout;
 
   std::unique_ptr<TaskflowCommandPools> commandPools;
   std::unique_ptr<ChunkManager> chunkManager;
-  std::unique_ptr<entt::DefaultRegistry> registry;
-  std::mutex registryMutex;
+  size_t chunkCacheBudget = ChunkCacheBudgetBytes;
+  std::unique_ptr<entt::DefaultRegistry> registry; // Only used by the update thread
+  InstrumentedMutex registryMutex; // Only held to create and destroy chunks
+  ChunkTable chunkTable; // What workers build, owned by whichever side the chunk's lifecycle state says
+  std::unique_ptr<VolumePool> volumePool;
+  std::unique_ptr<ChunkBufferPool> chunkBuffers; // Vertex/index heap, ranges freed once frames using them have finished
   std::unique_ptr<TerrainGenerator> terrainGen;
   std::unique_ptr<SurfaceExtractor> surfaceExtractor;
+  std::unique_ptr<UploadBatcher> uploadBatcher; // Flushed by drawChunks, once per frame
+  std::atomic<uint64_t> uploadsDirect{ 0 }; // Meshes too big for the ring, staged on their own
+  std::atomic<uint64_t> uploadDirectUs{ 0 };
   Frustum frustum;
+  ColumnOccupancy columnOccupancy;
+  ChunkPrefetcher prefetcher;
+  bool prefetching = PrefetchChunks;
+  std::atomic<uint32_t> pendingChunkJobs{ 0 }; // Spawned chunks queued or being built
+  std::atomic<uint32_t> chunkJobsInFlight{ 0 }; // Spawned chunks handed to the pipeline
+  std::unique_ptr<ChunkPipeline> chunkPipeline;
+  std::atomic<uint64_t> chunkJobsCancelled{ 0 }; // Stopped early or dropped from the queue after leaving range
+  std::atomic<uint64_t> chunkJobsDeferred{ 0 }; // Stopped for want of a volume slot or a failed upload, rescheduled
+  std::atomic<uint64_t> chunkJobsWasted{ 0 }; // Finished after leaving range, too late to cancel
+  std::atomic<uint64_t> chunkJobsCompleted{ 0 };
+  size_t spawnBacklogPeak = 0, despawnBacklogPeak = 0; // Deepest since the last counters were logged
+  ChunkScheduler chunkScheduler;
+  std::mutex deferredChunkJobsMutex;
+  std::vector<ChunkJob> deferredChunkJobs; // From the workers, back into chunkScheduler on the next update
+  bool frustumBuilt = false;
+  ChunkCoord lastCameraChunk = {};
+  bool lastCameraChunkValid = false;
+  std::mutex timeToVisibleMutex;
+  std::unordered_set<EntityHandle> timeToVisibleWaiting;
+  tp teleportTime;
+  double timeToVisibleMs = -1.0; // Latest result waiting to be logged
 
   std::vector<std::pair<EntityHandle, ChunkManager::ChunkStatus>> chunkSpawnList;
   std::vector<EntityHandle> chunkRenderList;
+  IndirectDrawList chunkDrawList;
+  uint64_t chunkDrawCalls = 0, chunkDrawListNs = 0; // Since the last counters were logged
 
   uint32_t nextFrameIndex=0;
   Camera camera;
@@ -137,7 +255,6 @@ private:
   struct PerChunkData {
     glm::mat4 model;
   };
-  size_t dynamicAlignment;
   struct LightData {
     alignas(16) glm::vec3 lightDir;
     alignas(16) glm::vec3 viewPos;
@@ -0,0 +1,32 @@
+#pragma once
+#include <cstdint>
+#include "metrics.hpp"
+
+// Limits how much of one kind of streaming work (spawning, despawning, starting
+// chunk jobs) a single update does, by count and by time, whichever runs out first.
+// The first item is always allowed so a backlog can't stall completely
+class FrameBudget
+{
+public:
+  FrameBudget(uint32_t const maxItems, uint32_t const maxMicroseconds)
+    : maxItems(maxItems)
+    , maxMicroseconds(maxMicroseconds)
+    , start(hr_clock::now())
+    , used(0)
+  {}
+
+  bool exhausted() const
+  {
+    if (used >= maxItems) return true;
+    return used > 0 && duration_cast<microseconds>(hr_clock::now() - start).count() >= maxMicroseconds;
+  }
+
+  void spend() { used++; }
+  uint32_t spent() const { return used; }
+
+private:
+  uint32_t const maxItems;
+  uint32_t const maxMicroseconds;
+  tp const start;
+  uint32_t used;
+};
@@ -0,0 +1,54 @@
+#include "IndirectDrawList.hpp"
+
+void IndirectDrawList::clear()
+{
+  draws.clear();
+  commands.clear();
+  batches.clear();
+}
+
+void IndirectDrawList::add(ModelData const & model, uint32_t const instance)
+{
+  draws.push_back({ model.vertexBuffer
+    , model.indexBuffer
+    , { model.indexCount, 1, model.indices.offset, static_cast<int32_t>(model.vertices.offset), instance }
+    , 0 });
+}
+
+void IndirectDrawList::build()
+{
+  commands.resize(draws.size());
+  batches.clear();
+
+  // Count each page pair's draws. There are only ever a few pages, a linear search beats hashing
+  for (auto & draw : draws)
+  {
+    uint32_t batch = 0;
+    while (batch < batches.size()
+      && (batches[batch].vertexBuffer != draw.vertexBuffer || batches[batch].indexBuffer != draw.indexBuffer))
+    {
+      batch++;
+    }
+    if (batch == batches.size())
+    {
+      batches.push_back({ draw.vertexBuffer, draw.indexBuffer, 0, 0 });
+    }
+    batches[batch].commandCount++;
+    draw.batch = batch;
+  }
+
+  uint32_t first = 0;
+  for (auto & batch : batches)
+  {
+    batch.firstCommand = first;
+    first += batch.commandCount;
+    batch.commandCount = 0; // Counted again as they're placed
+  }
+
+  // Stable, draws keep their order within a batch
+  for (auto const & draw : draws)
+  {
+    IndirectBatch & batch = batches[draw.batch];
+    commands[batch.firstCommand + batch.commandCount++] = draw.command;
+  }
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "components.hpp"
+
+// Commands which draw from the same pair of chunk buffer pages, one indirect draw
+struct IndirectBatch
+{
+  VkBuffer vertexBuffer, indexBuffer;
+  uint32_t firstCommand;
+  uint32_t commandCount;
+};
+
+// A frame's visible chunks as VkDrawIndexedIndirectCommands. Every chunk's mesh is a pair
+// of ranges in the ChunkBufferPool, so a draw is only numbers: firstIndex and vertexOffset
+// come from the ranges and firstInstance is the chunk's place in the frame's model
+// matrices, which the vertex shader reads back through gl_InstanceIndex. Commands are
+// grouped by page so each group goes in one vkCmdDrawIndexedIndirect with its pages bound,
+// usually there's only the one. CPU only, nothing here touches the device
+class IndirectDrawList
+{
+public:
+  void clear();
+  // instance is where the chunk's model matrix is in the frame's model buffer
+  void add(ModelData const & model, uint32_t const instance);
+  // Groups what's been added since clear by page, keeping the order within each page so
+  // the nearest chunks are still drawn first
+  void build();
+
+  // Valid after build
+  std::vector<VkDrawIndexedIndirectCommand> const & getCommands() const { return commands; }
+  std::vector<IndirectBatch> const & getBatches() const { return batches; }
+
+private:
+  struct Draw
+  {
+    VkBuffer vertexBuffer, indexBuffer;
+    VkDrawIndexedIndirectCommand command;
+    uint32_t batch;
+  };
+
+  std::vector<Draw> draws;
+  std::vector<VkDrawIndexedIndirectCommand> commands;
+  std::vector<IndirectBatch> batches;
+};
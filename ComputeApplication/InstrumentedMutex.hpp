@@ -0,0 +1,56 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include "metrics.hpp"
+
+struct LockStats
+{
+  uint64_t acquisitions;
+  uint64_t contended;   // Acquisitions which had to wait for another holder
+  uint64_t waitedNs;    // Total time spent waiting by contended acquisitions
+};
+
+// std::mutex which measures its own contention. An uncontended lock costs one try_lock,
+// only lockers which find it held pay for reading the clock. Usable with std::lock_guard
+class InstrumentedMutex
+{
+public:
+  void lock()
+  {
+    acquisitions.fetch_add(1, std::memory_order_relaxed);
+    if (mutex.try_lock()) return;
+
+    tp start = hr_clock::now();
+    mutex.lock();
+    waitedNs.fetch_add(duration_cast<nanoseconds>(hr_clock::now() - start).count(), std::memory_order_relaxed);
+    contended.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  bool try_lock()
+  {
+    if (!mutex.try_lock()) return false;
+    acquisitions.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  void unlock()
+  {
+    mutex.unlock();
+  }
+
+  LockStats getStats() const
+  {
+    return {
+      acquisitions.load(std::memory_order_relaxed),
+      contended.load(std::memory_order_relaxed),
+      waitedNs.load(std::memory_order_relaxed)
+    };
+  }
+
+private:
+  std::mutex mutex;
+  std::atomic<uint64_t> acquisitions{ 0 };
+  std::atomic<uint64_t> contended{ 0 };
+  std::atomic<uint64_t> waitedNs{ 0 };
+};
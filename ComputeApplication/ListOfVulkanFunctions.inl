@@ -92,6 +92,7 @@ DEVICE_LEVEL_VULKAN_FUNCTION(vkAllocateCommandBuffers)
 DEVICE_LEVEL_VULKAN_FUNCTION(vkCreateSemaphore)
 DEVICE_LEVEL_VULKAN_FUNCTION(vkCreateFence)
 DEVICE_LEVEL_VULKAN_FUNCTION(vkWaitForFences)
+DEVICE_LEVEL_VULKAN_FUNCTION(vkGetFenceStatus)
 DEVICE_LEVEL_VULKAN_FUNCTION(vkResetFences)
 DEVICE_LEVEL_VULKAN_FUNCTION(vkDestroyFence)
 DEVICE_LEVEL_VULKAN_FUNCTION(vkDestroySemaphore)
@@ -139,6 +140,7 @@ DEVICE_LEVEL_VULKAN_FUNCTION(vkCmdSetScissor)
 DEVICE_LEVEL_VULKAN_FUNCTION(vkCmdBindVertexBuffers)
 DEVICE_LEVEL_VULKAN_FUNCTION(vkCmdDraw)
 DEVICE_LEVEL_VULKAN_FUNCTION(vkCmdDrawIndexed)
+DEVICE_LEVEL_VULKAN_FUNCTION(vkCmdDrawIndexedIndirect)
 DEVICE_LEVEL_VULKAN_FUNCTION(vkCmdDispatch)
 DEVICE_LEVEL_VULKAN_FUNCTION(vkCmdDispatchIndirect)
 DEVICE_LEVEL_VULKAN_FUNCTION(vkCmdCopyImage)
@@ -0,0 +1,51 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include "meshoptimizer.h"
+#include "Vertex.hpp"
+
+// Final, optimised chunk mesh compressed with meshoptimizer's vertex and index
+// codecs. Decoding is fast enough that a cached chunk can go straight back to
+// the GPU instead of running DualMC and the optimisation passes again
+struct CompressedMesh
+{
+  bool built = false; // A built mesh can still have no triangles, e.g. chunks of empty air
+  uint32_t vertexCount = 0;
+  uint32_t indexCount = 0;
+  std::vector<unsigned char> vertexData;
+  std::vector<unsigned char> indexData;
+
+  size_t bytes() const
+  {
+    return sizeof(CompressedMesh) + vertexData.capacity() + indexData.capacity();
+  }
+};
+
+// Indices should already be optimised for vertex cache and fetch, the index codec relies on it
+inline void encodeMesh(std::vector<Vertex> const & vertices, std::vector<uint32_t> const & indices, CompressedMesh & out)
+{
+  out.built = true;
+  out.vertexCount = static_cast<uint32_t>(vertices.size());
+  out.indexCount = static_cast<uint32_t>(indices.size());
+  out.vertexData.clear();
+  out.indexData.clear();
+  if (out.indexCount == 0) return;
+
+  out.vertexData.resize(meshopt_encodeVertexBufferBound(vertices.size(), sizeof(Vertex)));
+  out.vertexData.resize(meshopt_encodeVertexBuffer(out.vertexData.data(), out.vertexData.size(), vertices.data(), vertices.size(), sizeof(Vertex)));
+  out.vertexData.shrink_to_fit();
+
+  out.indexData.resize(meshopt_encodeIndexBufferBound(indices.size(), vertices.size()));
+  out.indexData.resize(meshopt_encodeIndexBuffer(out.indexData.data(), out.indexData.size(), indices.data(), indices.size()));
+  out.indexData.shrink_to_fit();
+}
+
+inline bool decodeMesh(CompressedMesh const & in, std::vector<Vertex> & vertices, std::vector<uint32_t> & indices)
+{
+  vertices.resize(in.vertexCount);
+  indices.resize(in.indexCount);
+  if (in.indexCount == 0) return true;
+
+  return meshopt_decodeVertexBuffer(vertices.data(), vertices.size(), sizeof(Vertex), in.vertexData.data(), in.vertexData.size()) == 0
+      && meshopt_decodeIndexBuffer(indices.data(), indices.size(), sizeof(uint32_t), in.indexData.data(), in.indexData.size()) == 0;
+}
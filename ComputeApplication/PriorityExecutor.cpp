@@ -0,0 +1,203 @@
+#include "PriorityExecutor.hpp"
+#include <algorithm>
+
+namespace
+{
+  // Which executor, and which of its workers, the calling thread is. Unset on other threads
+  thread_local PriorityExecutor const * threadExecutor = nullptr;
+  thread_local uint32_t threadWorkerIndex = 0;
+}
+
+PriorityExecutor::PriorityExecutor(uint32_t const numWorkers, uint32_t const starvationLimit, WorkerStart const & onWorkerStart)
+  : starvationLimit(std::max(starvationLimit, 1u))
+{
+  uint32_t const count = std::max(numWorkers, 1u);
+  for (uint32_t i = 0; i < count; i++)
+  {
+    workers.push_back(std::make_unique<Worker>());
+  }
+  // Only start them once every worker exists, they steal from each other straight away
+  for (uint32_t i = 0; i < count; i++)
+  {
+    workers[i]->thread = std::thread([this, i, onWorkerStart]() {
+      if (onWorkerStart) onWorkerStart(i);
+      workerLoop(i);
+    });
+  }
+}
+
+PriorityExecutor::~PriorityExecutor()
+{
+  waitForAll();
+  {
+    std::lock_guard<std::mutex> lock(sleepMutex);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (auto & worker : workers)
+  {
+    worker->thread.join();
+  }
+}
+
+void PriorityExecutor::submit(TaskPriority const priority, Task task)
+{
+  size_t const level = static_cast<size_t>(priority);
+  uint32_t const target = threadExecutor == this
+    ? threadWorkerIndex
+    : nextWorker.fetch_add(1, std::memory_order_relaxed) % numWorkers();
+
+  // Counted before it's visible, a worker which takes it straight away never sees the counts go negative
+  pending.fetch_add(1);
+  levels[level].queued.fetch_add(1);
+  queuedTotal.fetch_add(1);
+  {
+    std::lock_guard<std::mutex> lock(workers[target]->mutex);
+    workers[target]->deques[level].push_back({ std::move(task), hr_clock::now() });
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(sleepMutex); // Can't slip in between a sleeper's check and its wait
+  }
+  wake.notify_one();
+}
+
+void PriorityExecutor::waitForAll()
+{
+  std::unique_lock<std::mutex> lock(idleMutex);
+  idle.wait(lock, [&]() { return pending.load() == 0; });
+}
+
+bool PriorityExecutor::waitFor(microseconds const timeout)
+{
+  std::unique_lock<std::mutex> lock(idleMutex);
+  return idle.wait_for(lock, timeout, [&]() { return pending.load() == 0; });
+}
+
+uint32_t PriorityExecutor::currentWorker() const
+{
+  return threadExecutor == this ? threadWorkerIndex : NotAWorker;
+}
+
+TaskPriorityStats PriorityExecutor::getStats(TaskPriority const priority) const
+{
+  LevelCounters const & counters = levels[static_cast<size_t>(priority)];
+  return {
+    counters.completed.load(std::memory_order_relaxed),
+    counters.stolen.load(std::memory_order_relaxed),
+    counters.promoted.load(std::memory_order_relaxed),
+    counters.waitUs.load(std::memory_order_relaxed),
+    counters.waitMaxUs.load(std::memory_order_relaxed)
+  };
+}
+
+void PriorityExecutor::resetPeaks()
+{
+  for (auto & counters : levels)
+  {
+    counters.waitMaxUs.store(0, std::memory_order_relaxed);
+  }
+}
+
+void PriorityExecutor::workerLoop(uint32_t const index)
+{
+  threadExecutor = this;
+  threadWorkerIndex = index;
+
+  while (true)
+  {
+    QueuedTask taken;
+    size_t level;
+    if (take(index, taken, level))
+    {
+      run(taken, level);
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(sleepMutex);
+    wake.wait(lock, [&]() { return stopping || queuedTotal.load() > 0; });
+    if (stopping && queuedTotal.load() == 0) return;
+  }
+}
+
+bool PriorityExecutor::take(uint32_t const index, QueuedTask & taken, size_t & level)
+{
+  size_t lowest = TaskPriorityCount; // Lowest priority level with anything queued
+  for (size_t l = TaskPriorityCount; l-- > 0;)
+  {
+    if (levels[l].queued.load() > 0)
+    {
+      lowest = l;
+      break;
+    }
+  }
+  if (lowest == TaskPriorityCount) return false;
+
+  Worker & self = *workers[index];
+  if (self.passedOver >= starvationLimit && takeLevel(index, lowest, taken))
+  {
+    levels[lowest].promoted.fetch_add(1, std::memory_order_relaxed);
+    self.passedOver = 0;
+    level = lowest;
+    return true;
+  }
+
+  for (size_t l = 0; l < TaskPriorityCount; l++)
+  {
+    if (takeLevel(index, l, taken))
+    {
+      self.passedOver = l < lowest ? self.passedOver + 1 : 0;
+      level = l;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool PriorityExecutor::takeLevel(uint32_t const index, size_t const level, QueuedTask & taken)
+{
+  if (levels[level].queued.load() == 0) return false;
+
+  // Own deque first, then the others starting from the next worker along so thieves spread out
+  uint32_t const count = numWorkers();
+  for (uint32_t i = 0; i < count; i++)
+  {
+    Worker & victim = *workers[(index + i) % count];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    auto & deque = victim.deques[level];
+    if (deque.empty()) continue;
+
+    // Front for owner and thieves alike, each level runs in roughly the order it was submitted
+    taken = std::move(deque.front());
+    deque.pop_front();
+    levels[level].queued.fetch_sub(1);
+    queuedTotal.fetch_sub(1);
+    if (i > 0)
+    {
+      levels[level].stolen.fetch_add(1, std::memory_order_relaxed);
+    }
+    return true;
+  }
+  return false;
+}
+
+void PriorityExecutor::run(QueuedTask & taken, size_t const level)
+{
+  LevelCounters & counters = levels[level];
+  uint64_t waited = duration_cast<microseconds>(hr_clock::now() - taken.queued).count();
+  counters.waitUs.fetch_add(waited, std::memory_order_relaxed);
+  uint64_t peak = counters.waitMaxUs.load(std::memory_order_relaxed);
+  while (waited > peak && !counters.waitMaxUs.compare_exchange_weak(peak, waited, std::memory_order_relaxed))
+  {
+  }
+
+  taken.task();
+  taken.task = nullptr; // Release anything it captured before anyone waiting is woken
+
+  counters.completed.fetch_add(1, std::memory_order_relaxed);
+  if (pending.fetch_sub(1) == 1)
+  {
+    std::lock_guard<std::mutex> lock(idleMutex);
+    idle.notify_all();
+  }
+}
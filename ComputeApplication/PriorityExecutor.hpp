@@ -0,0 +1,115 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "metrics.hpp"
+
+// Highest first. Workers always look for the most urgent work anywhere before taking
+// anything from a lower level
+enum class TaskPriority : uint32_t
+{
+  Chunk,        // Chunk builds the camera is waiting on
+  Prefetch,     // Speculative builds for where the camera is going
+  Housekeeping  // Background upkeep, e.g. building column occupancy
+};
+static constexpr size_t TaskPriorityCount = 3;
+static constexpr char const * TaskPriorityNames[TaskPriorityCount] = { "Chunk", "Prefetch", "Housekeeping" };
+
+struct TaskPriorityStats
+{
+  uint64_t completed;
+  uint64_t stolen;    // Taken from another worker's deque
+  uint64_t promoted;  // Taken ahead of higher priority work to keep this level from starving
+  uint64_t waitUs;    // Total time tasks spent queued
+  uint64_t waitMaxUs; // Since the last resetPeaks
+};
+
+// Work-stealing thread pool with a deque per priority level on every worker. A worker
+// takes from its own deques and steals from the others', level by level from the top,
+// so no worker runs prefetch or housekeeping while chunk work is queued anywhere.
+// Strict priority would starve the lower levels while chunks stream in, so once a
+// worker has taken starvationLimit tasks in a row ahead of queued lower priority work
+// it takes the oldest task of the lowest waiting level instead.
+// Unlike a tf::Taskflow tasks start as soon as they're submitted, there's no dispatch.
+// submit is safe from any thread, including from inside a task
+class PriorityExecutor
+{
+public:
+  using Task = std::function<void()>;
+  // Runs on each worker's own thread before it takes any tasks, e.g. to set its affinity
+  using WorkerStart = std::function<void(uint32_t worker)>;
+
+  PriorityExecutor(uint32_t const numWorkers, uint32_t const starvationLimit, WorkerStart const & onWorkerStart = nullptr);
+  ~PriorityExecutor(); // Finishes every submitted task first
+
+  PriorityExecutor(PriorityExecutor const &) = delete;
+  PriorityExecutor & operator=(PriorityExecutor const &) = delete;
+
+  void submit(TaskPriority const priority, Task task);
+  // Blocks until every submitted task, and any they submit, has finished. Not from a task
+  void waitForAll();
+  // As waitForAll but gives up after timeout, false if tasks were still running. Lets the
+  // caller keep doing work the tasks may be waiting on
+  bool waitFor(microseconds const timeout);
+
+  uint32_t numWorkers() const { return static_cast<uint32_t>(workers.size()); }
+
+  static constexpr uint32_t NotAWorker = 0xFFFFFFFF;
+  // Index of the calling thread among this executor's workers, NotAWorker for any other
+  // thread. Lets workers keep per-worker resources they never have to lock
+  uint32_t currentWorker() const;
+
+  TaskPriorityStats getStats(TaskPriority const priority) const;
+  void resetPeaks();
+
+private:
+  struct QueuedTask
+  {
+    Task task;
+    tp queued;
+  };
+
+  struct Worker
+  {
+    std::mutex mutex;
+    std::array<std::deque<QueuedTask>, TaskPriorityCount> deques;
+    uint32_t passedOver = 0; // Tasks taken in a row while lower priority work waited
+    std::thread thread;
+  };
+
+  struct LevelCounters
+  {
+    std::atomic<uint64_t> queued{ 0 };
+    std::atomic<uint64_t> completed{ 0 };
+    std::atomic<uint64_t> stolen{ 0 };
+    std::atomic<uint64_t> promoted{ 0 };
+    std::atomic<uint64_t> waitUs{ 0 };
+    std::atomic<uint64_t> waitMaxUs{ 0 };
+  };
+
+  void workerLoop(uint32_t const index);
+  bool take(uint32_t const index, QueuedTask & taken, size_t & level);
+  bool takeLevel(uint32_t const index, size_t const level, QueuedTask & taken);
+  void run(QueuedTask & taken, size_t const level);
+
+  uint32_t const starvationLimit;
+  std::vector<std::unique_ptr<Worker>> workers;
+  std::array<LevelCounters, TaskPriorityCount> levels;
+  std::atomic<uint32_t> nextWorker{ 0 }; // Round robin for tasks submitted from outside the pool
+
+  std::mutex sleepMutex;
+  std::condition_variable wake;
+  std::atomic<uint64_t> queuedTotal{ 0 };
+  bool stopping = false;
+
+  std::mutex idleMutex;
+  std::condition_variable idle;
+  std::atomic<uint64_t> pending{ 0 }; // Submitted and not yet finished
+};
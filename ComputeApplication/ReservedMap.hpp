@@ -1,15 +1,14 @@
 #pragma once
 #include <unordered_map>
+#include <cstdint>
 
 #include "common.hpp"
-#include "voxel.hpp"
-#include <array>
-using ChunkCacheData = std::array<Voxel, ChunkSize>;
 
-// ReservedMap class intended to be used with cpp-cache, takes a template
-// parameter with an initial size to reserve on construction. Should 
-// mean that the map doesn't have to reallocate or allocate additional 
-// space during runtime
+// ReservedMap class used as the storage for ChunkCache (originally written for
+// cpp-cache, hence the interface), takes a template parameter with an initial
+// size to reserve on construction. Should mean that the map doesn't have to
+// reallocate or allocate additional space during runtime. Values are moved in
+// and out rather than copied
 template<class Key
   , class T
   , uint32_t SizeToReserve
@@ -32,22 +31,27 @@ public:
   }
 
 protected:
+  bool contained_in_storage(const key_type& key) const
+  {
+    return map_.count(key) == 1;
+  }
+
   const stored_type& get_from_storage(const key_type& key) const
   {
     return map_.at(key);
   }
 
-  void insert_into_storage(const key_type& key, const stored_type& value)
+  // For moving a value out while the key keeps its node
+  stored_type& get_from_storage(const key_type& key)
   {
-    // check if we already know the key
-    auto it = map_.find(key);
+    return map_.at(key);
+  }
 
-    // if not add the key and value to the map
-    if (it == map_.end())
-      map_.insert(std::make_pair(key, value));
-    // otherwise update the value
-    else
-      map_[key] = value;
+  // Values are only ever moved in and out, stored_type can be move-only
+  void insert_into_storage(const key_type& key, stored_type&& value)
+  {
+    // adds the key or updates the existing value
+    map_.insert_or_assign(key, std::move(value));
   }
 
   void erase_from_storage(const key_type& key) const
@@ -1,31 +1,35 @@
 #include "SurfaceExtractor.hpp"
 #include "VulkanInterface.hpp"
 #include "vk_mem_alloc.h"
-#include "entt/entity/registry.hpp"
 
-bool SurfaceExtractor::extractSurface(uint32_t entity, entt::DefaultRegistry * registry, std::mutex * const registryMutex, uint32_t frame)
+bool SurfaceExtractor::buildMesh(ChunkVolume const & volume, std::vector<Vertex> & vertices, std::vector<uint32_t> & indices)
 {
-  DualMCVoxel dmc;
   std::vector<Vertex> generatedVerts;
   std::vector<dualmc::TriIndexType> generatedIndices;
 
-  constexpr uint16_t iso = static_cast<uint16_t>(0.5f * std::numeric_limits<uint16_t>::max());
+  buildTris(volume, generatedVerts, generatedIndices);
+  if (!optimiseMesh(generatedVerts, generatedIndices, vertices, indices))
+  {
+    return false;
+  }
+  computeNormals(vertices, indices);
 
-  registryMutex->lock();
-  auto & volume = registry->get<VolumeData>(entity);
-  dmc.buildTris(volume.volume.data(), TrueChunkDim, TrueChunkDim, TrueChunkDim, iso, true, false, generatedVerts, generatedIndices);
-  registryMutex->unlock();
+  return true;
+}
 
+void SurfaceExtractor::buildTris(ChunkVolume const & volume, std::vector<Vertex> & generatedVerts, std::vector<dualmc::TriIndexType> & generatedIndices)
+{
+  DualMCVoxel dmc;
+  dmc.buildTris(volume.data(), TrueChunkDim, TrueChunkDim, TrueChunkDim, iso, true, false, generatedVerts, generatedIndices);
+}
+
+bool SurfaceExtractor::optimiseMesh(std::vector<Vertex> & generatedVerts, std::vector<dualmc::TriIndexType> & generatedIndices, std::vector<Vertex> & vertices, std::vector<uint32_t> & indices)
+{
   size_t indexCount = generatedIndices.size(), vertexCount;
-  std::vector<Vertex> vertices;
-  std::vector<uint32_t> indices;
   if (indexCount == 0)
   {
-    registryMutex->lock();
-    auto & modelData = registry->get<ModelData>(entity);
-    modelData.indexCount = 0;
-    registryMutex->unlock();
-
+    vertices.clear();
+    indices.clear();
     return false;
   }
   else
@@ -56,28 +60,33 @@ bool SurfaceExtractor::extractSurface(uint32_t entity, entt::DefaultRegistry * r
   // Optimise vertex fetch
   vertices.resize(meshopt_optimizeVertexFetch(&vertices[0], &indices[0], indices.size(), &vertices[0], vertices.size(), sizeof(Vertex)));
 
-  // Generate normals
+  return true;
+}
+
+void SurfaceExtractor::computeNormals(std::vector<Vertex> & vertices, std::vector<uint32_t> const & indices)
+{
   generateNormals(vertices.data(), static_cast<uint32_t>(vertices.size()), indices.data(), static_cast<uint32_t>(indices.size()));
+}
+
+bool SurfaceExtractor::uploadMesh(uint32_t entity, uint32_t frame, std::vector<Vertex> & vertices, std::vector<uint32_t> & indices)
+{
+  chunks->advance(entity, ChunkLifecycle::Uploading);
 
   // Fill model data
-  auto[mutex, transferCommandBuffer] = commandPools->transferPools.getBuffer(frame);
+  auto transfer = commandPools->transferPools.getBuffer(frame);
+
+  // Built up on the side and committed in one go, a failed upload leaves the chunk as it was
+  ModelData modelData = emptyModel(entity);
 
   // Vertex Buffer
-  registryMutex->lock();
-  auto & modelData = registry->get<ModelData>(entity);
-  if (!VulkanInterface::CreateBuffer(*modelData.allocator
-    , sizeof(Vertex)*vertices.size()
-    , VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT
+  if (!chunkBuffers->acquire(ChunkBufferUsage::Vertex
+    , static_cast<uint32_t>(vertices.size())
+    , entity
     , modelData.vertexBuffer
-    , VMA_ALLOCATION_CREATE_STRATEGY_BEST_FIT_BIT
-    , VMA_MEMORY_USAGE_GPU_ONLY
-    , VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
-    , VK_NULL_HANDLE
-    , modelData.vbufferAllocation))
+    , modelData.vertices))
   {
     // TODO: "Failed to create vertex buffer for model data"
-    mutex->unlock();
-    registryMutex->unlock();
+    chunkBuffers->retire(modelData);
     return false;
   }
   // Fill Vertex Buffer
@@ -87,37 +96,31 @@ bool SurfaceExtractor::extractSurface(uint32_t entity, entt::DefaultRegistry * r
     , sizeof(Vertex)*vertices.size()
     , vertices.data()
     , modelData.vertexBuffer
-    , 0
+    , sizeof(Vertex)*modelData.vertices.offset
     , 0
     , VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT
     , VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT
     , VK_PIPELINE_STAGE_VERTEX_INPUT_BIT
     , *transferQueue
     , transferQMutex
-    , *transferCommandBuffer
+    , *transfer.buffer
     , {}
     ))
   {
     // TODO: "Failed to stage vertex data"
-    mutex->unlock();
-    registryMutex->unlock();
+    chunkBuffers->retire(modelData);
     return false;
   }
 
   // Index buffer
-  if (!VulkanInterface::CreateBuffer(*modelData.allocator
-    , sizeof(uint32_t)*indices.size()
-    , VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT
+  if (!chunkBuffers->acquire(ChunkBufferUsage::Index
+    , static_cast<uint32_t>(indices.size())
+    , entity
     , modelData.indexBuffer
-    , VMA_ALLOCATION_CREATE_STRATEGY_BEST_FIT_BIT
-    , VMA_MEMORY_USAGE_GPU_ONLY
-    , VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
-    , VK_NULL_HANDLE
-    , modelData.ibufferAllocation))
+    , modelData.indices))
   {
     // TODO: "Failed to create vertex buffer for model data"
-    mutex->unlock();
-    registryMutex->unlock();
+    chunkBuffers->retire(modelData);
     return false;
   }
   // Fill Index Buffer
@@ -127,25 +130,70 @@ bool SurfaceExtractor::extractSurface(uint32_t entity, entt::DefaultRegistry * r
     , sizeof(uint32_t)*indices.size()
     , indices.data()
     , modelData.indexBuffer
-    , 0
+    , sizeof(uint32_t)*modelData.indices.offset
     , 0
     , VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT
     , VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT
     , VK_PIPELINE_STAGE_VERTEX_INPUT_BIT
     , *transferQueue
     , transferQMutex
-    , *transferCommandBuffer
+    , *transfer.buffer
     , {}
   ))
   {
     // TODO: "Failed to stage vertex data"
-    mutex->unlock();
-    registryMutex->unlock();
+    chunkBuffers->retire(modelData);
     return false;
   }
   modelData.indexCount = static_cast<uint32_t>(indices.size());
-  mutex->unlock();
-  registryMutex->unlock();
+  commitModel(entity, modelData);
 
   return true;
 }
+
+bool SurfaceExtractor::stageMesh(uint32_t entity, std::vector<Vertex> const & vertices, std::vector<uint32_t> const & indices, UploadBatcher & batcher, std::function<void()> complete)
+{
+  chunks->advance(entity, ChunkLifecycle::Uploading);
+
+  ModelData modelData = emptyModel(entity);
+  VkDeviceSize const vertexBytes = sizeof(Vertex)*vertices.size();
+  VkDeviceSize const indexBytes = sizeof(uint32_t)*indices.size();
+  if (!chunkBuffers->acquire(ChunkBufferUsage::Vertex, static_cast<uint32_t>(vertices.size()), entity, modelData.vertexBuffer, modelData.vertices)
+    || !chunkBuffers->acquire(ChunkBufferUsage::Index, static_cast<uint32_t>(indices.size()), entity, modelData.indexBuffer, modelData.indices))
+  {
+    chunkBuffers->retire(modelData);
+    return false;
+  }
+  modelData.indexCount = static_cast<uint32_t>(indices.size());
+
+  // Nothing's drawn from the new buffers until the batch is done with them
+  bool staged = batcher.upload({ { vertices.data(), vertexBytes, modelData.vertexBuffer, sizeof(Vertex)*modelData.vertices.offset }
+      , { indices.data(), indexBytes, modelData.indexBuffer, sizeof(uint32_t)*modelData.indices.offset } }
+    , [this, entity, modelData, complete]() {
+      commitModel(entity, modelData);
+      complete();
+    });
+  if (!staged)
+  {
+    chunkBuffers->retire(modelData);
+  }
+  return staged;
+}
+
+void SurfaceExtractor::clearModel(uint32_t entity)
+{
+  commitModel(entity, emptyModel(entity));
+}
+
+ModelData SurfaceExtractor::emptyModel(uint32_t entity)
+{
+  return { VkBuffer(), VkBuffer(), chunks->get(entity).model.allocator, 0ui32 };
+}
+
+void SurfaceExtractor::commitModel(uint32_t entity, ModelData const & model)
+{
+  // A re-meshed chunk's old buffers may still be drawn by frames in flight
+  ModelData & current = chunks->get(entity).model;
+  chunkBuffers->retire(current);
+  current = model;
+}
@@ -5,27 +5,61 @@
 #include "common.hpp"
 #include "components.hpp"
 #include "TaskflowCommandPools.hpp"
+#include "VolumePool.hpp"
+#include "MeshCodec.hpp"
+#include "ChunkBufferPool.hpp"
+#include "ChunkTable.hpp"
+#include "UploadBatcher.hpp"
+#include <limits>
 #include <stack>
 #include <mutex>
-#include "entt\entity\registry.hpp"
 
 class SurfaceExtractor
 {
 public:
-  SurfaceExtractor(VkDevice * const logicalDevice, VkQueue * const transferQueue, std::mutex * const transferQMutex, TaskflowCommandPools * const commandPools)
+  SurfaceExtractor(VkDevice * const logicalDevice, VkQueue * const transferQueue, std::mutex * const transferQMutex, TaskflowCommandPools * const commandPools, ChunkBufferPool * const chunkBuffers, ChunkTable * const chunks)
     : logicalDevice(logicalDevice)
     , transferQueue(transferQueue)
     , transferQMutex(transferQMutex)
     , commandPools(commandPools)
+    , chunkBuffers(chunkBuffers)
+    , chunks(chunks)
   {}
   ~SurfaceExtractor() {}
 
+  // Meshes a volume that isn't attached to a chunk, e.g. prefetching. CPU only, the same
+  // stages as a chunk build without the upload. Returns false if the volume has no surface
+  bool buildMesh(ChunkVolume const & volume, std::vector<Vertex> & vertices, std::vector<uint32_t> & indices);
+
+  // The stages of a chunk's surface, for running them on different workers. None of them lock
+  // anything, the chunk stages must be called by the worker which owns the chunk
+  // DualMC over the volume
+  void buildTris(ChunkVolume const & volume, std::vector<Vertex> & generatedVerts, std::vector<dualmc::TriIndexType> & generatedIndices);
+  // Remap, simplify and optimise DualMC's output, returns false if there's nothing to draw
+  bool optimiseMesh(std::vector<Vertex> & generatedVerts, std::vector<dualmc::TriIndexType> & generatedIndices, std::vector<Vertex> & vertices, std::vector<uint32_t> & indices);
+  void computeNormals(std::vector<Vertex> & vertices, std::vector<uint32_t> const & indices);
   // TODO: consider whether frame is required, compute should be frame independent
-  bool extractSurface(uint32_t entity, entt::DefaultRegistry * registry, std::mutex * const registryMutex, uint32_t frame);
+  // Stages the mesh into new buffers and commits them to the chunk, retiring any it had
+  bool uploadMesh(uint32_t entity, uint32_t frame, std::vector<Vertex> & vertices, std::vector<uint32_t> & indices);
+  // As uploadMesh but copies the mesh into the batcher's ring and returns without waiting on the GPU.
+  // The model is committed and complete called on the main thread once the batch has finished.
+  // Returns false without touching the chunk's model if the mesh can't be staged, e.g. it's too big
+  bool stageMesh(uint32_t entity, std::vector<Vertex> const & vertices, std::vector<uint32_t> const & indices, UploadBatcher & batcher, std::function<void()> complete);
+  // Commits a model with nothing to draw, retiring any buffers the chunk had
+  void clearModel(uint32_t entity);
 
 private:
+  static constexpr uint16_t iso = static_cast<uint16_t>(0.5f * std::numeric_limits<uint16_t>::max());
+
+  // No buffers, keeps the chunk's allocator
+  ModelData emptyModel(uint32_t entity);
+  // Replaces the chunk's model, retiring any buffers it had
+  void commitModel(uint32_t entity, ModelData const & model);
+
   VkDevice * const logicalDevice;
   VkQueue * const transferQueue;
   std::mutex * const transferQMutex;
   TaskflowCommandPools * const commandPools;
+  ChunkBufferPool * const chunkBuffers;
+  ChunkTable * const chunks;
 };
@@ -1,15 +1,22 @@
 #pragma once
 #include "VulkanInterface.hpp"
+#include "PriorityExecutor.hpp"
+#include "InstrumentedMutex.hpp"
 #include <vector>
 #include <array> // For each frame
-#include <stack> // Pile of available command buffers
+#include <atomic>
 #include <mutex>
-#include <tuple>
 
-// Helper for getting a free command buffer for transfering data to the GPU, 
-// not the best construction in the world but provided you have a dedicated 
-// transfer pipeline you shouldn't have any issues even if you're sending 
-// data from various threads
+struct TransferPoolStats
+{
+  uint64_t workerLeases; // Taken by executor workers, without a lock
+  LockStats shared;      // Everyone else, through the shared set's lock
+};
+
+// Command buffers for transfering data to the GPU. Each executor worker has its own
+// pool per frame, found by its worker index, so uploads from workers never search or
+// lock. Any other thread (e.g. the main thread updating uniforms) shares one extra set
+// behind a lock
 class TaskflowCommandPools
 {
 public:
@@ -18,22 +25,31 @@ public:
   struct TransferPool
   {
   private:
-    cbufferPools pools;
+    cbufferPools pools; // One set per worker, then the shared set
     std::vector<std::array<VkCommandBuffer, 3>> buffers;
-    std::vector<std::mutex> mutexes;
     VkDevice * const logicalDevice;
+    PriorityExecutor const * const executor;
     uint32_t numWorkers;
-    std::mutex searchMutex;
+    InstrumentedMutex sharedMutex;
+    std::atomic<uint64_t> workerLeases{ 0 };
   public:
-    TransferPool(uint32_t numWorkers, uint32_t family, VkDevice * const logicalDevice)
+    // A command buffer for the calling thread to record and submit. Holds the shared
+    // set's lock if the caller isn't a worker, released when the lease goes
+    struct Lease
+    {
+      VkCommandBuffer * buffer;
+      std::unique_lock<InstrumentedMutex> lock;
+    };
+
+    TransferPool(PriorityExecutor const * const executor, uint32_t family, VkDevice * const logicalDevice)
       : logicalDevice(logicalDevice)
-      , numWorkers(numWorkers)
+      , executor(executor)
+      , numWorkers(executor->numWorkers())
     {
-      pools = cbufferPools(numWorkers);
-      buffers = std::vector<std::array<VkCommandBuffer, 3>>(numWorkers);
-      mutexes = std::vector<std::mutex>(numWorkers);
+      pools = cbufferPools(numWorkers + 1);
+      buffers = std::vector<std::array<VkCommandBuffer, 3>>(numWorkers + 1);
 
-      for (uint32_t thread = 0; thread < numWorkers; thread++)
+      for (uint32_t thread = 0; thread <= numWorkers; thread++)
       {
         for (uint32_t frame = 0; frame < 3; frame++)
         {
@@ -64,30 +80,23 @@ public:
       }
     }
 
-    // DONT FORGET TO UNLOCK THE MUTEX
-    std::tuple<std::mutex * const, VkCommandBuffer * const> getBuffer(uint32_t frame)
+    // Uploads wait for their fence, so the buffer is free again as soon as the caller's done with it
+    Lease getBuffer(uint32_t frame)
     {
-      // Find an unlocked thread
-      uint32_t thread = 0;
+      uint32_t worker = executor->currentWorker();
+      if (worker != PriorityExecutor::NotAWorker)
       {
-        std::unique_lock<std::mutex> lock(searchMutex);
-        for (auto & mutex : mutexes)
-        {
-          if (mutex.try_lock())
-          {
-            VkCommandBuffer * cbuf = &buffers[thread][frame];
-            return std::make_tuple(&mutex, cbuf);
-          }
-          else
-          {
-            thread++;
-          }
-        }
-      }      
-      // If we've fallen out of the loop something is probably wrong but just return the last mutex and hope it unlocks
-      mutexes[thread - 1].lock();
-      VkCommandBuffer * cbuf = &buffers[thread-1][frame];
-      return std::make_pair(&mutexes[thread-1], cbuf);
+        workerLeases.fetch_add(1, std::memory_order_relaxed);
+        return { &buffers[worker][frame], std::unique_lock<InstrumentedMutex>() };
+      }
+
+      std::unique_lock<InstrumentedMutex> lock(sharedMutex);
+      return { &buffers[numWorkers][frame], std::move(lock) };
+    }
+
+    TransferPoolStats getStats() const
+    {
+      return { workerLeases.load(std::memory_order_relaxed), sharedMutex.getStats() };
     }
 
     void cleanup()
@@ -105,10 +114,10 @@ public:
   TaskflowCommandPools(
       VkDevice * const logicalDevice
     , uint32_t transferQueueFamily
-    , uint32_t numWorkers
+    , PriorityExecutor const * const executor
   )
     : logicalDevice(logicalDevice)
-    , transferPools(numWorkers, transferQueueFamily, logicalDevice)
+    , transferPools(executor, transferQueueFamily, logicalDevice)
   {
     
   }
@@ -1,23 +1,23 @@
 #include "TerrainGenerator.hpp"
 #include <glm/common.hpp>
 #include <glm/mat4x4.hpp>
+#include <algorithm>
 
-std::array<Voxel, ChunkSize> TerrainGenerator::getChunkVolume(glm::vec3 chunkPos)
+bool TerrainGenerator::getChunkVolume(glm::vec3 chunkPos, Volume & volume, CancelToken const * cancel)
 {
-  Volume volume;
   HeightMap heightmap;
 
   // Normalise chunk position
   glm::vec3 normedChunkPos = chunkPos * invWorldDimensionInVoxels;
   genHeightMap(heightmap, normedChunkPos);
-  genVolume(heightmap, volume, chunkPos, normedChunkPos);
+  if (cancel && cancel->cancelled()) return false;
 
-  return volume;
+  genVolume(heightmap, volume, chunkPos, normedChunkPos);
+  return true;
 }
 
-std::array<Voxel, ChunkSize> TerrainGenerator::getChunkVolume(glm::vec3 chunkPos, logEntryData & data)
+bool TerrainGenerator::getChunkVolume(glm::vec3 chunkPos, Volume & volume, logEntryData & data, CancelToken const * cancel)
 {
-  Volume volume;
   HeightMap heightmap;  
 
   // Normalise chunk position
@@ -26,12 +26,12 @@ std::array<Voxel, ChunkSize> TerrainGenerator::getChunkVolume(glm::vec3 chunkPos
   data.heightStart = hr_clock::now();
   genHeightMap(heightmap, normedChunkPos);
   data.heightEnd = hr_clock::now();
+  if (cancel && cancel->cancelled()) return false;
 
   data.volumeStart = hr_clock::now();
   genVolume(heightmap, volume, chunkPos, normedChunkPos);  
   data.volumeEnd = hr_clock::now();
-
-  return volume;
+  return true;
 }
 
 // Calculate basic height map (this can/should be GPU compute for more complex multi biome setups)
@@ -45,47 +45,69 @@ void TerrainGenerator::genHeightMap(HeightMap& heightmap, glm::vec3 normedChunkP
   {
     for (float x = normedChunkPos.x - normedHalfChunkDim; x < normedChunkPos.x + normedHalfChunkDim; x += voxelStep, ++hm_p)
     {
-      float theta = x * 2.0f * static_cast<float>(PI);
-      float phi = z * 2.0f * static_cast<float>(PI);
-      float h_amp = 1.0f;
-      float h_r = 64.f;
-      float height = 0.0f;
-      {
-        {
-          glm::vec4 p = glm::vec4(
-            h_r * std::cos(theta),
-            h_r * std::sin(theta),
-            h_r * std::cos(phi),
-            h_r * std::sin(phi)
-          );
-          height = h_amp * (1.f - glm::abs(noise.GetSimplex(p.x, p.y, p.z, p.w)));
-          h_amp *= 0.8f;
-          h_r *= 2.0f;
-        }
-        for (int i = 0; i < 1; i++)
-        {
-          glm::vec4 p = glm::vec4(
-            h_r * std::cos(theta),
-            h_r * std::sin(theta),
-            h_r * std::cos(phi),
-            h_r * std::sin(phi)
-          );
-          height -= h_amp * (1.f - glm::abs(noise.GetSimplex(p.x, p.y, p.z, p.w)));
-          h_amp *= 0.4f;
-          h_r *= 2.45f;
-        }
-      }
-      // Apply terracing for some interesting terrain features
-      // Via: https://gamedev.stackexchange.com/a/116222/53817
-      float w = 0.2f;
-      float k = glm::floor(height / w);
-      float f = (height - k * w) / w;
-      float s = glm::min(2.f*f, 1.f);
-      height = ((k + s) * w);
-      height = glm::clamp(height, -1.f, 1.f);
-      heightmap[hm_p] = (height*.5f) + .5f; // ensure heightmap range is [0,1]
+      heightmap[hm_p] = sampleHeight(x, z);
+    }
+  }
+}
+
+float TerrainGenerator::surfaceHeight(glm::vec3 chunkPos)
+{
+  glm::vec3 normedChunkPos = chunkPos * invWorldDimensionInVoxels;
+  return sampleHeight(normedChunkPos.x, normedChunkPos.z) * heightMapHeightInVoxels;
+}
+
+void TerrainGenerator::columnHeightRange(glm::vec3 chunkPos, float & lowest, float & highest)
+{
+  // Same samples genVolume gets, so the range is exact rather than an estimate
+  HeightMap heightmap;
+  genHeightMap(heightmap, chunkPos * invWorldDimensionInVoxels);
+
+  auto range = std::minmax_element(heightmap.begin(), heightmap.end());
+  lowest = *range.first * heightMapHeightInVoxels;
+  highest = *range.second * heightMapHeightInVoxels;
+}
+
+float TerrainGenerator::sampleHeight(float x, float z)
+{
+  float theta = x * 2.0f * static_cast<float>(PI);
+  float phi = z * 2.0f * static_cast<float>(PI);
+  float h_amp = 1.0f;
+  float h_r = 64.f;
+  float height = 0.0f;
+  {
+    {
+      glm::vec4 p = glm::vec4(
+        h_r * std::cos(theta),
+        h_r * std::sin(theta),
+        h_r * std::cos(phi),
+        h_r * std::sin(phi)
+      );
+      height = h_amp * (1.f - glm::abs(noise.GetSimplex(p.x, p.y, p.z, p.w)));
+      h_amp *= 0.8f;
+      h_r *= 2.0f;
+    }
+    for (int i = 0; i < 1; i++)
+    {
+      glm::vec4 p = glm::vec4(
+        h_r * std::cos(theta),
+        h_r * std::sin(theta),
+        h_r * std::cos(phi),
+        h_r * std::sin(phi)
+      );
+      height -= h_amp * (1.f - glm::abs(noise.GetSimplex(p.x, p.y, p.z, p.w)));
+      h_amp *= 0.4f;
+      h_r *= 2.45f;
     }
   }
+  // Apply terracing for some interesting terrain features
+  // Via: https://gamedev.stackexchange.com/a/116222/53817
+  float w = 0.2f;
+  float k = glm::floor(height / w);
+  float f = (height - k * w) / w;
+  float s = glm::min(2.f*f, 1.f);
+  height = ((k + s) * w);
+  height = glm::clamp(height, -1.f, 1.f);
+  return (height*.5f) + .5f; // ensure heightmap range is [0,1]
 }
 
 void TerrainGenerator::genVolume(HeightMap& heightmap, Volume& volume, glm::vec3 chunkPos, glm::vec3 normedChunkPos)
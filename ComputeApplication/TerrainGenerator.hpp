@@ -9,6 +9,7 @@
 #include <glm/common.hpp>
 #include <glm/mat4x4.hpp>
 #include "metrics.hpp"
+#include "CancelToken.hpp"
 
 class TerrainGenerator
 {
@@ -21,12 +22,28 @@ public:
     noise.SetSeed(seed);
   }
 
-  std::array<Voxel, ChunkSize> getChunkVolume(glm::vec3 chunkPos);
-  std::array<Voxel, ChunkSize> getChunkVolume(glm::vec3 chunkPos, logEntryData & data);
+  // Generates directly into the given volume, typically a VolumePool slot.
+  // Returns false if cancelled between the heightmap and volume stages, the volume is left incomplete
+  bool getChunkVolume(glm::vec3 chunkPos, Volume & volume, CancelToken const * cancel = nullptr);
+  bool getChunkVolume(glm::vec3 chunkPos, Volume & volume, logEntryData & data, CancelToken const * cancel = nullptr);
 
   void genHeightMap(HeightMap & heightmap, glm::vec3 normedChunkPos);
   void genVolume(HeightMap& heightmap, Volume & volume, glm::vec3 chunkPos, glm::vec3 normedChunkPos);
 
+  // Heightmap height in voxels at the centre of the chunk's column, roughly where its terrain surface is
+  float surfaceHeight(glm::vec3 chunkPos);
+
+  // Lowest and highest heightmap height in voxels over every voxel column of the chunk's column
+  void columnHeightRange(glm::vec3 chunkPos, float & lowest, float & highest);
+
+  // Most genVolume's noise octaves can move the surface away from the heightmap, in voxels.
+  // Six octaves starting at amplitude 1 and falling by 0.6 each, scaled by 64
+  static constexpr float MaxNoiseDisplacement = 64.f * (1.f + 0.6f + 0.36f + 0.216f + 0.1296f + 0.07776f);
+
 private:
+  // Heightmap value in [0,1] at a normalised world position
+  float sampleHeight(float x, float z);
+
+
    FastNoise noise;
 };
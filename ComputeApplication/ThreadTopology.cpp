@@ -0,0 +1,182 @@
+#include "ThreadTopology.hpp"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#if defined(_WIN32)
+#include <Windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace
+{
+  // CPUs this process may run on, in order
+  std::vector<uint32_t> usableCpus()
+  {
+    std::vector<uint32_t> cpus;
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0)
+    {
+      for (uint32_t cpu = 0; cpu < CPU_SETSIZE; cpu++)
+      {
+        if (CPU_ISSET(cpu, &set)) cpus.push_back(cpu);
+      }
+    }
+#endif
+    if (cpus.empty())
+    {
+      uint32_t const count = std::max(std::thread::hardware_concurrency(), 1u);
+      for (uint32_t cpu = 0; cpu < count; cpu++)
+      {
+        cpus.push_back(cpu);
+      }
+    }
+    return cpus;
+  }
+
+#if defined(__linux__)
+  // Linux cpulist format, e.g. 0-3,8-11
+  std::vector<uint32_t> parseCpuList(std::string const & list)
+  {
+    std::vector<uint32_t> cpus;
+    std::stringstream ranges(list);
+    std::string range;
+    while (std::getline(ranges, range, ','))
+    {
+      if (range.empty()) continue;
+      size_t dash = range.find('-');
+      uint32_t first = static_cast<uint32_t>(std::stoul(range.substr(0, dash)));
+      uint32_t last = dash == std::string::npos ? first : static_cast<uint32_t>(std::stoul(range.substr(dash + 1)));
+      for (uint32_t cpu = first; cpu <= last; cpu++)
+      {
+        cpus.push_back(cpu);
+      }
+    }
+    return cpus;
+  }
+
+  // CPUs on the same NUMA node as the calling thread, empty if it can't be found
+  std::vector<uint32_t> currentNodeCpus()
+  {
+    int current = sched_getcpu();
+    if (current < 0) return {};
+
+    // Node numbers can have gaps, e.g. after hot-unplugging
+    constexpr uint32_t MaxNodes = 64;
+    for (uint32_t node = 0; node < MaxNodes; node++)
+    {
+      std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+      if (!file.is_open()) continue;
+      std::string list;
+      std::getline(file, list);
+      std::vector<uint32_t> cpus = parseCpuList(list);
+      if (std::find(cpus.begin(), cpus.end(), static_cast<uint32_t>(current)) != cpus.end())
+      {
+        return cpus;
+      }
+    }
+    return {};
+  }
+#endif
+
+  bool pinCurrentThread(std::vector<uint32_t> const & cpus)
+  {
+    if (cpus.empty()) return false;
+#if defined(_WIN32)
+    DWORD_PTR mask = 0;
+    for (uint32_t cpu : cpus)
+    {
+      if (cpu < sizeof(DWORD_PTR) * 8) mask |= DWORD_PTR(1) << cpu; // Only the calling thread's processor group
+    }
+    return mask != 0 && SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (uint32_t cpu : cpus)
+    {
+      CPU_SET(cpu, &set);
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+  }
+
+  bool canPin()
+  {
+#if defined(_WIN32) || defined(__linux__)
+    return true;
+#else
+    return false;
+#endif
+  }
+}
+
+ThreadTopology::ThreadTopology(ThreadTopologyConfig const & config)
+{
+  std::vector<uint32_t> cpus = usableCpus();
+  bool numa = false;
+#if defined(__linux__)
+  if (config.numaLocal)
+  {
+    // Only the ones we're allowed to run on
+    std::vector<uint32_t> node = currentNodeCpus();
+    std::vector<uint32_t> local;
+    for (uint32_t cpu : cpus)
+    {
+      if (std::find(node.begin(), node.end(), cpu) != node.end()) local.push_back(cpu);
+    }
+    if (!local.empty() && local.size() < cpus.size())
+    {
+      cpus = local;
+      numa = true;
+    }
+  }
+#endif
+
+  // Always leave at least one core for chunk work
+  uint32_t const frameCores = std::min(config.frameCores, static_cast<uint32_t>(cpus.size()) - 1);
+  workers = std::max(static_cast<uint32_t>(cpus.size()) - frameCores, 1u);
+
+  bool const pin = config.pin && canPin();
+  if (pin)
+  {
+    frameCpus.assign(cpus.begin(), cpus.begin() + frameCores);
+    chunkCpus.assign(cpus.begin() + frameCores, cpus.end());
+  }
+  else if (numa)
+  {
+    // Without pinning the node is still kept by giving every thread the whole node
+    frameCpus = cpus;
+    chunkCpus = cpus;
+  }
+
+  description = "frame" + std::to_string(frameCores);
+  if (pin) description += "-pinned";
+  if (numa) description += "-numa";
+}
+
+void ThreadTopology::pinFrameThread() const
+{
+  thread_local bool pinned = false;
+  if (pinned) return;
+  pinned = true;
+  pinCurrentThread(frameCpus);
+}
+
+void ThreadTopology::pinChunkWorker(uint32_t const index) const
+{
+  if (chunkCpus.empty()) return;
+  if (frameCpus == chunkCpus)
+  {
+    pinCurrentThread(chunkCpus); // Node wide
+  }
+  else
+  {
+    pinCurrentThread({ chunkCpus[index % chunkCpus.size()] });
+  }
+}
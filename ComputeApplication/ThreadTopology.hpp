@@ -0,0 +1,39 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct ThreadTopologyConfig
+{
+  uint32_t frameCores; // Cores kept back for the main and update threads, 0 gives chunk workers every core
+  bool pin;            // Pin frame threads to their reserved cores and each chunk worker to its own core
+  bool numaLocal;      // Only use the main thread's NUMA node, Linux only
+};
+
+// Which cores the app's threads run on. The frame path (the main thread and the update
+// taskflow) gets frameCores to itself and the chunk workers get the rest, by sizing the
+// pool to fit and, if pinning, by affinity as well so the scheduler can't put a chunk
+// worker on a frame core. With numaLocal the other nodes are left alone so volumes,
+// caches and meshes stay on one memory controller
+class ThreadTopology
+{
+public:
+  ThreadTopology() = default;
+  // Lays out the threads for this machine, pinning falls back to none where it isn't supported
+  explicit ThreadTopology(ThreadTopologyConfig const & config);
+
+  uint32_t chunkWorkers() const { return workers; }
+  // Short description for logs, e.g. frame2-pinned-numa
+  std::string const & name() const { return description; }
+
+  // Call from any thread on the frame path, only the first call on each thread does anything
+  void pinFrameThread() const;
+  // Call from chunk worker index's own thread as it starts
+  void pinChunkWorker(uint32_t const index) const;
+
+private:
+  uint32_t workers = 1;
+  std::string description;
+  std::vector<uint32_t> frameCpus; // Empty unless pinning
+  std::vector<uint32_t> chunkCpus; // Empty unless pinning, worker i runs on chunkCpus[i % size]
+};
@@ -0,0 +1,362 @@
+#include "TlsfAllocator.hpp"
+#include <algorithm>
+#include <cassert>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace
+{
+  // Index of the highest set bit, v mustn't be 0
+  uint32_t highestBit(uint32_t const v)
+  {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanReverse(&index, v);
+    return index;
+#else
+    return 31 - __builtin_clz(v);
+#endif
+  }
+
+  // Index of the lowest set bit, v mustn't be 0
+  uint32_t lowestBit(uint32_t const v)
+  {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, v);
+    return index;
+#else
+    return __builtin_ctz(v);
+#endif
+  }
+}
+
+TlsfAllocator::TlsfAllocator(uint32_t const capacity)
+  : totalUnits(capacity)
+{
+  for (auto & lists : freeLists)
+  {
+    lists.fill(InvalidHandle);
+  }
+  if (capacity == 0) return;
+
+  blocks.push_back({ 0, capacity, InvalidHandle, InvalidHandle, InvalidHandle, InvalidHandle, NoKey, true });
+  lastBlock = 0;
+  insertFree(0);
+}
+
+uint32_t TlsfAllocator::allocate(uint32_t const size, uint32_t const key)
+{
+  if (size == 0) return InvalidHandle;
+
+  uint32_t const handle = findFree(size);
+  if (handle == InvalidHandle) return InvalidHandle;
+  removeFree(handle);
+
+  // Split the rest off as a free block of its own
+  if (blocks[handle].size > size)
+  {
+    uint32_t const rest = newBlock(); // May reallocate blocks
+    Block & block = blocks[handle];
+    blocks[rest] = { block.offset + size, block.size - size, handle, block.nextPhysical, InvalidHandle, InvalidHandle, NoKey, true };
+    if (block.nextPhysical != InvalidHandle)
+    {
+      blocks[block.nextPhysical].prevPhysical = rest;
+    }
+    else
+    {
+      lastBlock = rest;
+    }
+    block.nextPhysical = rest;
+    block.size = size;
+    insertFree(rest);
+  }
+
+  Block & block = blocks[handle];
+  block.free = false;
+  block.key = key;
+  allocations++;
+  usedUnits += size;
+  return handle;
+}
+
+void TlsfAllocator::free(uint32_t const handle)
+{
+  assert(!blocks[handle].free);
+  allocations--;
+  usedUnits -= blocks[handle].size;
+
+  uint32_t merged = handle;
+  blocks[merged].free = true;
+  blocks[merged].key = NoKey;
+
+  // Absorb the next block, then let the previous one absorb this. The lower block's handle survives
+  uint32_t const next = blocks[merged].nextPhysical;
+  if (next != InvalidHandle && blocks[next].free)
+  {
+    removeFree(next);
+    blocks[merged].size += blocks[next].size;
+    blocks[merged].nextPhysical = blocks[next].nextPhysical;
+    if (blocks[next].nextPhysical != InvalidHandle)
+    {
+      blocks[blocks[next].nextPhysical].prevPhysical = merged;
+    }
+    else
+    {
+      lastBlock = merged;
+    }
+    unusedBlocks.push_back(next);
+  }
+
+  uint32_t const prev = blocks[merged].prevPhysical;
+  if (prev != InvalidHandle && blocks[prev].free)
+  {
+    removeFree(prev);
+    blocks[prev].size += blocks[merged].size;
+    blocks[prev].nextPhysical = blocks[merged].nextPhysical;
+    if (blocks[merged].nextPhysical != InvalidHandle)
+    {
+      blocks[blocks[merged].nextPhysical].prevPhysical = prev;
+    }
+    else
+    {
+      lastBlock = prev;
+    }
+    unusedBlocks.push_back(merged);
+    merged = prev;
+  }
+
+  insertFree(merged);
+}
+
+std::vector<TlsfMove> TlsfAllocator::planCompaction(uint32_t const maxMoves)
+{
+  std::vector<TlsfMove> moves;
+  if (blocks.empty()) return moves;
+
+  // Every block tried costs an allocate and maybe a free, give up after a few misses per move
+  uint32_t attempts = maxMoves * 4;
+  uint32_t current = lastBlock;
+  while (current != InvalidHandle && moves.size() < maxMoves && attempts > 0)
+  {
+    // allocate may split the block below, taking the lower part, which is then skipped for having NoKey
+    uint32_t const below = blocks[current].prevPhysical;
+    if (!blocks[current].free && blocks[current].key != NoKey)
+    {
+      attempts--;
+      uint32_t const size = blocks[current].size;
+      uint32_t const to = allocate(size);
+      if (to != InvalidHandle && blocks[to].offset < blocks[current].offset)
+      {
+        moves.push_back({ blocks[current].key, current, to, blocks[current].offset, blocks[to].offset, size });
+      }
+      else if (to != InvalidHandle)
+      {
+        free(to); // Only room above it, it'd be no better off
+      }
+    }
+    current = below;
+  }
+  return moves;
+}
+
+TlsfStats TlsfAllocator::getStats() const
+{
+  uint32_t const largest = largestFree();
+  return { allocations, freeBlocks, usedUnits, totalUnits - usedUnits, largest == InvalidHandle ? 0 : blocks[largest].size };
+}
+
+double TlsfAllocator::fragmentation() const
+{
+  uint64_t const freeUnits = totalUnits - usedUnits;
+  uint32_t const largest = largestFree();
+  if (freeUnits == 0 || largest == InvalidHandle) return 0.0;
+  return 1.0 - static_cast<double>(blocks[largest].size) / static_cast<double>(freeUnits);
+}
+
+bool TlsfAllocator::validate() const
+{
+  if (blocks.empty())
+  {
+    return totalUnits == 0 && allocations == 0 && freeBlocks == 0 && usedUnits == 0 && firstLevelMap == 0;
+  }
+  if (lastBlock >= blocks.size() || blocks[lastBlock].nextPhysical != InvalidHandle) return false;
+
+  // Back from the top to find the bottom, bounded in case the links loop
+  uint32_t first = lastBlock;
+  size_t steps = 0;
+  while (blocks[first].prevPhysical != InvalidHandle)
+  {
+    first = blocks[first].prevPhysical;
+    if (first >= blocks.size() || ++steps > blocks.size()) return false;
+  }
+
+  // The blocks must tile the range with no gaps, and no two free blocks can be neighbours
+  uint32_t allocated = 0, freeCount = 0;
+  uint64_t used = 0, end = 0;
+  steps = 0;
+  for (uint32_t handle = first; handle != InvalidHandle; handle = blocks[handle].nextPhysical)
+  {
+    if (handle >= blocks.size() || ++steps > blocks.size()) return false;
+    Block const & block = blocks[handle];
+    if (block.size == 0 || block.offset != end) return false;
+    uint32_t const next = block.nextPhysical;
+    if (next != InvalidHandle && (next >= blocks.size() || blocks[next].prevPhysical != handle)) return false;
+    if (next == InvalidHandle && handle != lastBlock) return false;
+    if (block.free)
+    {
+      if (next != InvalidHandle && blocks[next].free) return false;
+      if (block.key != NoKey) return false;
+      freeCount++;
+    }
+    else
+    {
+      allocated++;
+      used += block.size;
+    }
+    end += block.size;
+  }
+  if (end != totalUnits || allocated != allocations || used != usedUnits || freeCount != freeBlocks) return false;
+
+  // Every free block on the list its size maps to, and a bit set for exactly the lists with something on them
+  uint32_t listed = 0;
+  for (uint32_t firstLevel = 0; firstLevel < FirstLevelCount; firstLevel++)
+  {
+    if (((firstLevelMap >> firstLevel) & 1) != (secondLevelMaps[firstLevel] != 0 ? 1u : 0u)) return false;
+    for (uint32_t secondLevel = 0; secondLevel < SecondLevelCount; secondLevel++)
+    {
+      uint32_t const head = freeLists[firstLevel][secondLevel];
+      if (((secondLevelMaps[firstLevel] >> secondLevel) & 1) != (head != InvalidHandle ? 1u : 0u)) return false;
+
+      uint32_t prev = InvalidHandle;
+      for (uint32_t handle = head; handle != InvalidHandle; handle = blocks[handle].nextFree)
+      {
+        if (handle >= blocks.size() || ++listed > freeBlocks) return false;
+        Block const & block = blocks[handle];
+        uint32_t f, s;
+        mapping(block.size, f, s);
+        if (!block.free || block.prevFree != prev || f != firstLevel || s != secondLevel) return false;
+        prev = handle;
+      }
+    }
+  }
+  return listed == freeBlocks;
+}
+
+void TlsfAllocator::mapping(uint32_t const size, uint32_t & firstLevel, uint32_t & secondLevel)
+{
+  if (size < SecondLevelCount)
+  {
+    // Small sizes each get a list of their own in the first row
+    firstLevel = 0;
+    secondLevel = size;
+    return;
+  }
+  uint32_t const power = highestBit(size);
+  firstLevel = power - SecondLevelLog2 + 1;
+  secondLevel = (size >> (power - SecondLevelLog2)) - SecondLevelCount;
+}
+
+uint32_t TlsfAllocator::newBlock()
+{
+  if (!unusedBlocks.empty())
+  {
+    uint32_t const handle = unusedBlocks.back();
+    unusedBlocks.pop_back();
+    return handle;
+  }
+  blocks.push_back({});
+  return static_cast<uint32_t>(blocks.size() - 1);
+}
+
+uint32_t TlsfAllocator::findFree(uint32_t const size) const
+{
+  // Round up to the next list so any block on the list found is big enough. A size already
+  // on a list's lower bound stays put, or a request for the whole range could never fit
+  uint64_t rounded = size;
+  if (size >= SecondLevelCount)
+  {
+    uint64_t const step = uint64_t(1) << (highestBit(size) - SecondLevelLog2);
+    rounded = (rounded + step - 1) & ~(step - 1);
+  }
+  if (rounded > totalUnits) return InvalidHandle;
+
+  uint32_t firstLevel, secondLevel;
+  mapping(static_cast<uint32_t>(rounded), firstLevel, secondLevel);
+
+  uint32_t secondMap = secondLevelMaps[firstLevel] & (~0u << secondLevel);
+  if (secondMap == 0)
+  {
+    // Nothing on this row that's big enough, take the smallest list of a larger power of two
+    uint32_t const firstMap = firstLevel + 1 < 32 ? firstLevelMap & (~0u << (firstLevel + 1)) : 0;
+    if (firstMap == 0) return InvalidHandle;
+    firstLevel = lowestBit(firstMap);
+    secondMap = secondLevelMaps[firstLevel];
+  }
+  return freeLists[firstLevel][lowestBit(secondMap)];
+}
+
+uint32_t TlsfAllocator::largestFree() const
+{
+  if (firstLevelMap == 0) return InvalidHandle;
+
+  // The highest list holds the largest blocks but isn't sorted
+  uint32_t const firstLevel = highestBit(firstLevelMap);
+  uint32_t const secondLevel = highestBit(secondLevelMaps[firstLevel]);
+  uint32_t largest = freeLists[firstLevel][secondLevel];
+  for (uint32_t handle = blocks[largest].nextFree; handle != InvalidHandle; handle = blocks[handle].nextFree)
+  {
+    if (blocks[handle].size > blocks[largest].size) largest = handle;
+  }
+  return largest;
+}
+
+void TlsfAllocator::insertFree(uint32_t const handle)
+{
+  uint32_t firstLevel, secondLevel;
+  mapping(blocks[handle].size, firstLevel, secondLevel);
+
+  uint32_t & head = freeLists[firstLevel][secondLevel];
+  blocks[handle].prevFree = InvalidHandle;
+  blocks[handle].nextFree = head;
+  if (head != InvalidHandle)
+  {
+    blocks[head].prevFree = handle;
+  }
+  head = handle;
+
+  firstLevelMap |= 1u << firstLevel;
+  secondLevelMaps[firstLevel] |= 1u << secondLevel;
+  freeBlocks++;
+}
+
+void TlsfAllocator::removeFree(uint32_t const handle)
+{
+  uint32_t firstLevel, secondLevel;
+  mapping(blocks[handle].size, firstLevel, secondLevel);
+
+  Block & block = blocks[handle];
+  if (block.prevFree != InvalidHandle)
+  {
+    blocks[block.prevFree].nextFree = block.nextFree;
+  }
+  else
+  {
+    freeLists[firstLevel][secondLevel] = block.nextFree;
+  }
+  if (block.nextFree != InvalidHandle)
+  {
+    blocks[block.nextFree].prevFree = block.prevFree;
+  }
+
+  if (freeLists[firstLevel][secondLevel] == InvalidHandle)
+  {
+    secondLevelMaps[firstLevel] &= ~(1u << secondLevel);
+    if (secondLevelMaps[firstLevel] == 0)
+    {
+      firstLevelMap &= ~(1u << firstLevel);
+    }
+  }
+  freeBlocks--;
+}
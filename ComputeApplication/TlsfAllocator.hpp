@@ -0,0 +1,102 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <vector>
+
+struct TlsfStats
+{
+  uint32_t allocations;
+  uint32_t freeBlocks;
+  uint64_t usedUnits;
+  uint64_t freeUnits;
+  uint64_t largestFreeUnits;
+};
+
+// One block planCompaction wants moved to a lower offset
+struct TlsfMove
+{
+  uint32_t key;
+  uint32_t from, to; // Handles
+  uint32_t fromOffset, toOffset;
+  uint32_t size;
+};
+
+// Two-level segregated fit allocator over a range of capacity units. Doesn't own any
+// memory, it hands out offsets, so the same code suballocates vertex buffers in vertices
+// and index buffers in indices, and runs without a device. Free blocks are kept on lists
+// by size, one per power of two split into SecondLevelCount steps, with a bitmap of which
+// lists have anything on them, so allocate and free are constant time. allocate takes the
+// first block from the smallest list whose blocks are all big enough and splits off the
+// rest, free merges a block with its free neighbours.
+// Each block can carry a key, e.g. the chunk using it, so planCompaction can say whose data
+// to move. Not thread safe
+class TlsfAllocator
+{
+public:
+  static constexpr uint32_t InvalidHandle = 0xFFFFFFFF;
+  static constexpr uint32_t NoKey = 0xFFFFFFFF;
+
+  explicit TlsfAllocator(uint32_t const capacity);
+
+  // Handle of a block of exactly size units, InvalidHandle if no free block is big enough
+  uint32_t allocate(uint32_t const size, uint32_t const key = NoKey);
+  void free(uint32_t const handle);
+
+  uint32_t offset(uint32_t const handle) const { return blocks[handle].offset; }
+  uint32_t size(uint32_t const handle) const { return blocks[handle].size; }
+  uint32_t key(uint32_t const handle) const { return blocks[handle].key; }
+  // Blocks with NoKey are never picked by planCompaction
+  void setKey(uint32_t const handle, uint32_t const key) { blocks[handle].key = key; }
+
+  // Walks down from the top of the range looking for keyed blocks which fit in a free block
+  // lower down, and allocates a block there for each, up to maxMoves. The caller copies each
+  // one's data across and frees from, or frees to to call the move off. The new blocks
+  // have NoKey until the caller sets it
+  std::vector<TlsfMove> planCompaction(uint32_t const maxMoves);
+
+  uint32_t capacity() const { return totalUnits; }
+  TlsfStats getStats() const;
+  // 0 when the free space is all one block, towards 1 the more it's split up
+  double fragmentation() const;
+  // Walks every block and free list checking the allocator's own bookkeeping, e.g. that the
+  // blocks tile the range, free neighbours have been merged and the bitmaps match the lists.
+  // Slow, for -bench heapcheck
+  bool validate() const;
+
+private:
+  static constexpr uint32_t SecondLevelLog2 = 4;
+  static constexpr uint32_t SecondLevelCount = 1 << SecondLevelLog2;
+  static constexpr uint32_t FirstLevelCount = 32 - SecondLevelLog2 + 1;
+
+  struct Block
+  {
+    uint32_t offset;
+    uint32_t size;
+    uint32_t prevPhysical, nextPhysical; // Neighbouring blocks in the range
+    uint32_t prevFree, nextFree;         // Neighbours on its free list, while it's free
+    uint32_t key;
+    bool free;
+  };
+
+  // First and second level of the list holding blocks of size
+  static void mapping(uint32_t const size, uint32_t & firstLevel, uint32_t & secondLevel);
+
+  uint32_t newBlock();
+  uint32_t findFree(uint32_t const size) const;
+  uint32_t largestFree() const;
+  void insertFree(uint32_t const handle);
+  void removeFree(uint32_t const handle);
+
+  uint32_t const totalUnits;
+  std::vector<Block> blocks;
+  std::vector<uint32_t> unusedBlocks; // Slots in blocks to reuse
+  uint32_t lastBlock = 0;             // Highest offset
+
+  uint32_t firstLevelMap = 0;
+  std::array<uint32_t, FirstLevelCount> secondLevelMaps = {};
+  std::array<std::array<uint32_t, SecondLevelCount>, FirstLevelCount> freeLists;
+
+  uint32_t allocations = 0;
+  uint32_t freeBlocks = 0;
+  uint64_t usedUnits = 0;
+};
@@ -0,0 +1,234 @@
+#include "UploadBatcher.hpp"
+#include "VulkanInterface.Functions.hpp"
+#include "metrics.hpp"
+#include <cassert>
+#include <cstring>
+#include <limits>
+
+UploadBatcher::UploadBatcher(VkDevice * const logicalDevice, VmaAllocator * const allocator, VkQueue * const queue, std::mutex * const queueMutex, uint32_t const queueFamily, VkDeviceSize const ringBytes)
+  : logicalDevice(logicalDevice)
+  , allocator(allocator)
+  , queue(queue)
+  , queueMutex(queueMutex)
+  , ringBytes(ringBytes)
+{
+  VkBuffer buffer;
+  VmaAllocation allocation;
+  if (!VulkanInterface::CreateBuffer(*allocator
+    , ringBytes
+    , VK_BUFFER_USAGE_TRANSFER_SRC_BIT
+    , buffer
+    , 0
+    , VMA_MEMORY_USAGE_CPU_TO_GPU
+    , VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+    , VK_NULL_HANDLE
+    , allocation))
+  {
+    return;
+  }
+
+  // Stays mapped for the batcher's life
+  void * pointer;
+  if (vmaMapMemory(*allocator, allocation, &pointer) != VK_SUCCESS)
+  {
+    vmaDestroyBuffer(*allocator, buffer, allocation);
+    return;
+  }
+
+  ring = buffer;
+  ringAllocation = allocation;
+  mapped = static_cast<uint8_t*>(pointer);
+
+  // destroy leaves the batcher not ready if any of the rest fails
+  std::vector<VkCommandBuffer> commandBuffers;
+  if (!VulkanInterface::CreateCommandPool(*logicalDevice, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT, queueFamily, commandPool)
+    || !VulkanInterface::AllocateCommandBuffers(*logicalDevice, commandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, BatchesInFlight, commandBuffers))
+  {
+    destroy();
+    return;
+  }
+  for (uint32_t i = 0; i < BatchesInFlight; i++)
+  {
+    batches[i].commandBuffer = commandBuffers[i];
+    if (!VulkanInterface::CreateFence(*logicalDevice, false, batches[i].fence))
+    {
+      destroy();
+      return;
+    }
+  }
+}
+
+UploadBatcher::~UploadBatcher()
+{
+  assert(pending.empty() && head == tail);
+}
+
+bool UploadBatcher::upload(std::vector<StagedCopy> const & copies, std::function<void()> complete)
+{
+  VkDeviceSize total = 0;
+  for (auto const & copy : copies)
+  {
+    total += (copy.size + CopyAlignment - 1) / CopyAlignment * CopyAlignment;
+  }
+  // Anything over a quarter of the ring would hold up everyone else while it waited for room
+  if (!isReady() || total > ringBytes / 4) return false;
+
+  std::unique_lock<std::mutex> lock(ringMutex);
+  uint64_t start;
+  tp blockedSince;
+  bool blocked = false;
+  while (true)
+  {
+    // The copies are kept contiguous, skip to the start of the ring if they'd wrap
+    uint64_t offset = head % ringBytes;
+    start = (offset + total > ringBytes) ? head + (ringBytes - offset) : head;
+    if (start + total - tail <= ringBytes) break;
+
+    if (!blocked)
+    {
+      blocked = true;
+      blockedSince = hr_clock::now();
+    }
+    spaceFreed.wait(lock); // Until the main thread's flushed and the GPU's caught up
+  }
+  if (blocked)
+  {
+    stats.blockedUs += duration_cast<microseconds>(hr_clock::now() - blockedSince).count();
+  }
+
+  // Copied while holding the lock, a flush mustn't submit copies whose data isn't there yet
+  head = start;
+  for (auto const & copy : copies)
+  {
+    VkDeviceSize offset = head % ringBytes;
+    std::memcpy(mapped + offset, copy.data, copy.size);
+    pending.push_back({ offset, copy.size, copy.destination, copy.destinationOffset });
+    head += (copy.size + CopyAlignment - 1) / CopyAlignment * CopyAlignment;
+    stats.bytes += copy.size;
+  }
+  pendingCompletions.push_back(std::move(complete));
+  stats.uploads++;
+  return true;
+}
+
+bool UploadBatcher::flush()
+{
+  if (!isReady()) return true;
+
+  Batch & batch = batches[nextBatch];
+  if (batch.inFlight)
+  {
+    // Every slot's in flight, the GPU is a whole frame of batches behind
+    if (!VulkanInterface::WaitForFences(*logicalDevice, { batch.fence }, VK_FALSE, std::numeric_limits<uint64_t>::max()))
+    {
+      return false;
+    }
+    collect();
+  }
+
+  std::vector<PendingCopy> copies;
+  std::vector<std::function<void()>> completions;
+  uint64_t end;
+  {
+    std::lock_guard<std::mutex> lock(ringMutex);
+    if (pending.empty()) return true;
+    copies.swap(pending);
+    completions.swap(pendingCompletions);
+    end = head;
+  }
+
+  vmaFlushAllocation(*allocator, ringAllocation, 0, VK_WHOLE_SIZE); // No-op on coherent memory
+
+  if (!VulkanInterface::BeginCommandBufferRecordingOp(batch.commandBuffer, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT, nullptr))
+  {
+    return false;
+  }
+  std::vector<VulkanInterface::BufferTransition> transitions;
+  for (auto const & copy : copies)
+  {
+    VulkanInterface::CopyDataBetweenBuffers(batch.commandBuffer, ring, copy.destination, { { copy.ringOffset, copy.destinationOffset, copy.size } });
+    VulkanInterface::AddChunkBufferReadTransition(transitions, copy.destination);
+  }
+  // One barrier per buffer for the whole batch rather than one per copy
+  VulkanInterface::SetBufferMemoryBarrier(batch.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, transitions);
+  if (!VulkanInterface::EndCommandBufferRecordingOp(batch.commandBuffer))
+  {
+    return false;
+  }
+
+  if (!VulkanInterface::ResetFences(*logicalDevice, { batch.fence })
+    || !VulkanInterface::SubmitCommandBuffersToQueue(*queue, {}, { batch.commandBuffer }, {}, batch.fence, queueMutex))
+  {
+    return false;
+  }
+
+  batch.inFlight = true;
+  batch.ringEnd = end;
+  batch.completions = std::move(completions);
+  nextBatch = (nextBatch + 1) % BatchesInFlight;
+  {
+    std::lock_guard<std::mutex> lock(ringMutex);
+    stats.batches++;
+  }
+  return true;
+}
+
+void UploadBatcher::collect()
+{
+  // Batches finish in the order they were submitted, stop at the first one still running
+  while (batches[oldestBatch].inFlight && VulkanInterface::IsFenceSignalled(*logicalDevice, batches[oldestBatch].fence))
+  {
+    complete(batches[oldestBatch]);
+    oldestBatch = (oldestBatch + 1) % BatchesInFlight;
+  }
+}
+
+void UploadBatcher::drain()
+{
+  flush();
+  while (batches[oldestBatch].inFlight)
+  {
+    VulkanInterface::WaitForFences(*logicalDevice, { batches[oldestBatch].fence }, VK_FALSE, std::numeric_limits<uint64_t>::max());
+    complete(batches[oldestBatch]);
+    oldestBatch = (oldestBatch + 1) % BatchesInFlight;
+  }
+}
+
+void UploadBatcher::destroy()
+{
+  if (!isReady()) return;
+
+  for (auto & batch : batches)
+  {
+    VulkanInterface::DestroyFence(*logicalDevice, batch.fence);
+  }
+  VulkanInterface::DestroyCommandPool(*logicalDevice, commandPool);
+  vmaUnmapMemory(*allocator, ringAllocation);
+  vmaDestroyBuffer(*allocator, ring, ringAllocation);
+  ring = VK_NULL_HANDLE;
+  mapped = nullptr;
+}
+
+UploadBatcherStats UploadBatcher::getStats()
+{
+  std::lock_guard<std::mutex> lock(ringMutex);
+  UploadBatcherStats current = stats;
+  current.ringBytesInUse = head - tail;
+  return current;
+}
+
+void UploadBatcher::complete(Batch & batch)
+{
+  {
+    std::lock_guard<std::mutex> lock(ringMutex);
+    tail = batch.ringEnd;
+  }
+  spaceFreed.notify_all();
+
+  batch.inFlight = false;
+  for (auto & completion : batch.completions)
+  {
+    completion();
+  }
+  batch.completions.clear();
+}
@@ -0,0 +1,109 @@
+#pragma once
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+#include "VulkanInterface.hpp"
+#include "vk_mem_alloc.h"
+#include "common.hpp"
+
+struct StagedCopy
+{
+  void const * data;
+  VkDeviceSize size;
+  VkBuffer destination;
+  VkDeviceSize destinationOffset;
+};
+
+struct UploadBatcherStats
+{
+  uint64_t uploads;        // Calls to upload, each may be several copies
+  uint64_t bytes;
+  uint64_t batches;        // Submissions, at most one per flush
+  uint64_t blockedUs;      // Time uploaders spent waiting for ring space
+  uint64_t ringBytesInUse; // Staged or in flight
+};
+
+// Stages uploads through one persistently mapped ring buffer and submits everything
+// staged since the last flush as one command buffer, so workers copy their data into
+// the ring and carry on instead of each creating a staging buffer and fence and waiting
+// on the GPU. Each flush is a batch with a serial, and batches complete in serial order
+// on the queue, so the fences are read like a timeline: the newest signalled batch frees
+// the ring up to where it ended and runs the completion callbacks of its uploads.
+// upload is safe from any thread, flush, collect and drain are for the main thread
+class UploadBatcher
+{
+public:
+  UploadBatcher(VkDevice * const logicalDevice, VmaAllocator * const allocator, VkQueue * const queue, std::mutex * const queueMutex, uint32_t const queueFamily, VkDeviceSize const ringBytes);
+  ~UploadBatcher();
+
+  UploadBatcher(UploadBatcher const &) = delete;
+  UploadBatcher & operator=(UploadBatcher const &) = delete;
+
+  bool isReady() const { return ring != VK_NULL_HANDLE; }
+
+  // Copies the data into the ring for the next flush, blocking while the ring is full.
+  // complete runs on the main thread once the copies have finished on the GPU. False if
+  // the copies are too big to stage, upload them some other way
+  bool upload(std::vector<StagedCopy> const & copies, std::function<void()> complete);
+
+  // Submits everything staged since the last flush as one batch. Once per frame
+  bool flush();
+  // Polls the batches in flight without waiting, frees their ring space and runs their callbacks
+  void collect();
+  // Flushes and waits for every batch to finish
+  void drain();
+  // After drain, device must be idle
+  void destroy();
+
+  UploadBatcherStats getStats();
+
+private:
+  struct PendingCopy
+  {
+    VkDeviceSize ringOffset;
+    VkDeviceSize size;
+    VkBuffer destination;
+    VkDeviceSize destinationOffset;
+  };
+
+  struct Batch
+  {
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    VkFence fence = VK_NULL_HANDLE;
+    bool inFlight = false;
+    uint64_t ringEnd = 0; // Ring position after the batch's last copy
+    std::vector<std::function<void()>> completions;
+  };
+
+  void complete(Batch & batch);
+
+  static constexpr uint32_t BatchesInFlight = 3; // One per frame in flight
+  static constexpr VkDeviceSize CopyAlignment = 16;
+
+  VkDevice * const logicalDevice;
+  VmaAllocator * const allocator;
+  VkQueue * const queue;
+  std::mutex * const queueMutex;
+  VkDeviceSize const ringBytes;
+
+  VkBuffer ring = VK_NULL_HANDLE;
+  VmaAllocation ringAllocation = VK_NULL_HANDLE;
+  uint8_t * mapped = nullptr;
+  VkCommandPool commandPool = VK_NULL_HANDLE;
+
+  // Main thread only
+  std::array<Batch, BatchesInFlight> batches;
+  uint32_t nextBatch = 0;   // Slot the next flush submits with
+  uint32_t oldestBatch = 0; // Oldest slot which may still be in flight
+
+  std::mutex ringMutex;
+  std::condition_variable spaceFreed;
+  uint64_t head = 0; // Byte positions which only ever grow, the ring offset is position % ringBytes
+  uint64_t tail = 0; // Everything before tail has been copied by the GPU
+  std::vector<PendingCopy> pending;
+  std::vector<std::function<void()>> pendingCompletions;
+  UploadBatcherStats stats = {};
+};
@@ -0,0 +1,80 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include "voxel.hpp"
+#include "VolumePool.hpp"
+
+// Densities are clamped during generation so most of a chunk is long runs of
+// fully solid or fully empty voxels, a simple run-length encoding shrinks a
+// typical surface chunk to a few KB and uniform chunks to nothing at all
+struct VoxelRun
+{
+  uint16_t length; // ChunkSize fits comfortably in 16 bits
+  Voxel voxel;
+};
+
+struct CompressedVolume
+{
+  bool uniform = false;
+  Voxel uniformVoxel = { 0 };
+  std::vector<VoxelRun> runs;
+
+  bool empty() const
+  {
+    return !uniform && runs.empty();
+  }
+
+  size_t bytes() const
+  {
+    return sizeof(CompressedVolume) + runs.capacity() * sizeof(VoxelRun);
+  }
+};
+
+inline void compressVolume(ChunkVolume const & volume, CompressedVolume & out)
+{
+  out.runs.clear();
+  out.uniform = false;
+
+  VoxelRun run = { 1, volume[0] };
+  for (uint32_t i = 1; i < ChunkSize; i++)
+  {
+    if (volume[i].density == run.voxel.density)
+    {
+      run.length++;
+    }
+    else
+    {
+      out.runs.push_back(run);
+      run = { 1, volume[i] };
+    }
+  }
+
+  if (out.runs.empty()) // Only ever saw one value, no need to keep any runs
+  {
+    out.uniform = true;
+    out.uniformVoxel = run.voxel;
+  }
+  else
+  {
+    out.runs.push_back(run);
+    out.runs.shrink_to_fit();
+  }
+}
+
+inline void decompressVolume(CompressedVolume const & in, ChunkVolume & volume)
+{
+  if (in.uniform)
+  {
+    volume.fill(in.uniformVoxel);
+    return;
+  }
+
+  uint32_t i = 0;
+  for (auto const & run : in.runs)
+  {
+    for (uint32_t end = i + run.length; i < end; i++)
+    {
+      volume[i] = run.voxel;
+    }
+  }
+}
@@ -0,0 +1,134 @@
+#include "VolumePool.hpp"
+#include <cassert>
+#if defined(_WIN32)
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace
+{
+  constexpr size_t hugePageSize = 2 * 1024 * 1024;
+
+  size_t roundUp(size_t const value, size_t const multiple)
+  {
+    return ((value + multiple - 1) / multiple) * multiple;
+  }
+}
+
+VolumePool::VolumePool(uint32_t volumesPerSlab, uint32_t maxSlabs, uint32_t initialSlabs, bool useHugePages)
+  : volumesPerSlab(volumesPerSlab)
+  , maxSlabs(maxSlabs)
+  , useHugePages(useHugePages)
+  , slabs(new ChunkVolume*[maxSlabs]())
+  , slabCount(0)
+  , volumesInUse(0)
+{
+  // Round slabs up to whole huge pages so the OS can back them entirely with large pages
+  slabBytes = roundUp(sizeof(ChunkVolume) * volumesPerSlab, hugePageSize);
+  freeList.reserve(static_cast<size_t>(volumesPerSlab) * maxSlabs);
+
+  for (uint32_t i = 0; i < initialSlabs && i < maxSlabs; i++)
+  {
+    if (!allocateSlab())
+    {
+      break;
+    }
+  }
+}
+
+VolumePool::~VolumePool()
+{
+  assert(volumesInUse == 0);
+  for (uint32_t i = 0; i < slabCount; i++)
+  {
+    freeSlab(slabs[i]);
+  }
+}
+
+VolumeHandle VolumePool::acquire()
+{
+  std::unique_lock<std::mutex> lock(freeListMutex);
+  if (freeList.empty() && !allocateSlab())
+  {
+    return InvalidVolumeHandle;
+  }
+
+  VolumeHandle handle = freeList.back();
+  freeList.pop_back();
+  volumesInUse++;
+  return handle;
+}
+
+void VolumePool::release(VolumeHandle const handle)
+{
+  if (handle == InvalidVolumeHandle) return;
+
+  std::unique_lock<std::mutex> lock(freeListMutex);
+  freeList.push_back(handle);
+  volumesInUse--;
+}
+
+// Must be called with freeListMutex held (or from the constructor)
+bool VolumePool::allocateSlab()
+{
+  uint32_t slabIndex = slabCount.load();
+  if (slabIndex >= maxSlabs)
+  {
+    return false;
+  }
+
+  void * memory = nullptr;
+#if defined(_WIN32)
+  if (useHugePages)
+  {
+    // Requires SeLockMemoryPrivilege, fall back to regular pages if we don't have it
+    size_t largePageSize = GetLargePageMinimum();
+    if (largePageSize > 0)
+    {
+      memory = VirtualAlloc(nullptr, roundUp(slabBytes, largePageSize), MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+    }
+  }
+  if (memory == nullptr)
+  {
+    memory = VirtualAlloc(nullptr, slabBytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+  }
+#else
+  memory = mmap(nullptr, slabBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (memory == MAP_FAILED)
+  {
+    memory = nullptr;
+  }
+  else if (useHugePages)
+  {
+    // Only a hint, transparent huge pages may be disabled on this system
+    madvise(memory, slabBytes, MADV_HUGEPAGE);
+  }
+#endif
+  if (memory == nullptr)
+  {
+    return false;
+  }
+
+  // Voxels are trivial types, fresh pages are all the initialisation they need
+  ChunkVolume * slab = static_cast<ChunkVolume*>(memory);
+  slabs[slabIndex] = slab;
+
+  // Push in reverse so handles are handed out in ascending order
+  for (uint32_t i = volumesPerSlab; i > 0; i--)
+  {
+    freeList.push_back(slabIndex * volumesPerSlab + (i - 1));
+  }
+  slabCount++;
+
+  return true;
+}
+
+void VolumePool::freeSlab(ChunkVolume * slab)
+{
+#if defined(_WIN32)
+  VirtualFree(slab, 0, MEM_RELEASE);
+#else
+  munmap(slab, slabBytes);
+#endif
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "common.hpp"
+#include "voxel.hpp"
+
+using ChunkVolume = std::array<Voxel, ChunkSize>;
+using VolumeHandle = uint32_t;
+static constexpr VolumeHandle InvalidVolumeHandle = 0xFFFFFFFF;
+
+// Slab allocator for chunk volume payloads. Volumes are handed out as small
+// handles into large fixed size slabs which are never moved or freed until
+// the pool is destroyed, so a handle (and any reference obtained through it)
+// stays valid until it is released. Keeps the 93KB volumes out of the entt
+// component pools, which only need to shuffle the handle around.
+class VolumePool
+{
+public:
+  VolumePool(uint32_t volumesPerSlab, uint32_t maxSlabs, uint32_t initialSlabs, bool useHugePages);
+  ~VolumePool();
+
+  VolumePool(VolumePool const &) = delete;
+  VolumePool & operator=(VolumePool const &) = delete;
+
+  // Returns InvalidVolumeHandle if the pool has reached maxSlabs and every slot is in use
+  VolumeHandle acquire();
+  void release(VolumeHandle const handle);
+
+  ChunkVolume & get(VolumeHandle const handle)
+  {
+    return slabs[handle / volumesPerSlab][handle % volumesPerSlab];
+  }
+
+  uint32_t capacity() const { return slabCount.load() * volumesPerSlab; }
+  uint32_t inUse() const { return volumesInUse.load(); }
+
+private:
+  bool allocateSlab();
+  void freeSlab(ChunkVolume * slab);
+
+  uint32_t const volumesPerSlab;
+  uint32_t const maxSlabs;
+  bool const useHugePages;
+  size_t slabBytes;
+
+  // Fixed size so readers never observe a reallocation, only slabCount grows
+  std::unique_ptr<ChunkVolume*[]> slabs;
+  std::atomic<uint32_t> slabCount;
+  std::atomic<uint32_t> volumesInUse;
+
+  std::mutex freeListMutex;
+  std::vector<VolumeHandle> freeList;
+};
@@ -1,5 +1,6 @@
 #include "VulkanInterface.hpp"
 #include "vk_mem_alloc.h"
+#include <algorithm>
 #include <sstream>
 
 namespace VulkanInterface
@@ -1010,6 +1011,12 @@ return true;
     return false;
   }
 
+  bool IsFenceSignalled(VkDevice logicalDevice
+    , VkFence fence)
+  {
+    return vkGetFenceStatus(logicalDevice, fence) == VK_SUCCESS;
+  }
+
   bool ResetFences(VkDevice logicalDevice
     , std::vector<VkFence> const & fences)
   {
@@ -1281,6 +1288,17 @@ return true;
     }
   }
 
+  void AddChunkBufferReadTransition(std::vector<BufferTransition> & bufferTransitions
+                                  , VkBuffer buffer)
+  {
+    // Most copies land in the same few chunk buffer pages
+    bool seen = std::any_of(bufferTransitions.begin(), bufferTransitions.end(), [&](auto const & transition) { return transition.buffer == buffer; });
+    if (!seen)
+    {
+      bufferTransitions.push_back({ buffer, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED });
+    }
+  }
+
   bool CreateBufferView(VkDevice logicalDevice
                       , VkBuffer buffer
                       , VkFormat format
@@ -3256,6 +3274,15 @@ return true;
     vkCmdDrawIndexed(commandBuffer, indexCount, instanceCount, firstIndex, vertexOffset, firstInstance);
   }
 
+  void DrawIndexedGeometryIndirect( VkCommandBuffer commandBuffer
+                                  , VkBuffer buffer
+                                  , VkDeviceSize offset
+                                  , uint32_t drawCount
+                                  , uint32_t stride)
+  {
+    vkCmdDrawIndexedIndirect(commandBuffer, buffer, offset, drawCount, stride);
+  }
+
   void DispatchComputeWork( VkCommandBuffer commandBuffer
                           , uint32_t xSize
                           , uint32_t ySize
@@ -276,6 +276,9 @@ namespace VulkanInterface
                     , uint64_t timeout);
   bool ResetFences( VkDevice logicalDevice
                   , std::vector<VkFence> const & fences);
+  // Doesn't wait, false if the fence is unsignalled or the device was lost
+  bool IsFenceSignalled(VkDevice logicalDevice
+                      , VkFence fence);
   bool SubmitCommandBuffersToQueue( VkQueue queue
                                   , std::vector<WaitSemaphoreInfo> waitSemaphoreInfos
                                   , std::vector<VkCommandBuffer> commandBuffers
@@ -321,6 +324,10 @@ namespace VulkanInterface
                             , VkPipelineStageFlags generatingStages
                             , VkPipelineStageFlags consumingStages
                             , std::vector<BufferTransition> bufferTransitions);
+  // Transfer write to vertex and index reads, for chunk buffers which have been copied into.
+  // Only adds the buffer if it isn't already there, so any number of copies get one barrier
+  void AddChunkBufferReadTransition(std::vector<BufferTransition> & bufferTransitions
+                                  , VkBuffer buffer);
   bool CreateBufferView(VkDevice logicalDevice
                       , VkBuffer buffer
                       , VkFormat format
@@ -845,6 +852,12 @@ namespace VulkanInterface
                           , uint32_t vertexOffset
                           , uint32_t firstInstance);
 
+  void DrawIndexedGeometryIndirect( VkCommandBuffer commandBuffer
+                                  , VkBuffer buffer
+                                  , VkDeviceSize offset
+                                  , uint32_t drawCount
+                                  , uint32_t stride);
+
   void DispatchComputeWork( VkCommandBuffer commandBuffer
                           , uint32_t xSize
                           , uint32_t ySize
@@ -10,8 +10,9 @@ layout(set = 0, binding = 0) uniform ViewProj {
   mat4 proj;
 };
 
-layout(set = 0, binding = 1) uniform Model {
-  mat4 model;
+// Every chunk drawn this frame, each draw's firstInstance says which is its
+layout(std430, set = 0, binding = 1) readonly buffer Models {
+  mat4 models[];
 };
 
 layout(location = 0) in vec3 position;
@@ -22,6 +23,7 @@ layout(location = 1) out vec3 fragPos;
 
 void main()
 {
+  mat4 model = models[gl_InstanceIndex];
   vertexNormal = mat3(transpose(inverse(model))) * normal;
   fragPos = vec3(model * vec4(position, 1.0));
 
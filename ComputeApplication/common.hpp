@@ -1,13 +1,17 @@
 #pragma once
+#include <cstddef>
 static constexpr unsigned int TrueChunkDim = 36; // 32 + 2 voxel overlap along edges
 static constexpr unsigned int TechnicalChunkDim = TrueChunkDim - 4;
 static constexpr unsigned int HalfChunkDim = TrueChunkDim / 2;
 static constexpr unsigned int ChunkSize = TrueChunkDim * TrueChunkDim * TrueChunkDim; // ChunkDim cubed
-static constexpr unsigned int ChunkMapCacheSize = 256; // Arbitrary cache size 
+static constexpr size_t ChunkCacheBudgetBytes = 64 * 1024 * 1024; // Default, can be changed with -cacheBudgetMB
+static constexpr unsigned int ChunkCacheReserveEntries = 4096; // Initial storage reservation, not a limit
+static constexpr unsigned int ChunkCacheShards = 16; // Independently locked slices of the chunk cache
 static constexpr unsigned int chunkSpawnDistance = 7;
 static constexpr unsigned int chunkViewDistance = 6;
 static constexpr unsigned int maxChunks = chunkViewDistance * chunkViewDistance * chunkViewDistance;
 static constexpr unsigned int WorldDimension = 32; // In chunks
+static constexpr unsigned int ChunkMapHeight = 32; // Vertical chunks the ChunkMap indexes directly, more than the despawn diameter
 static constexpr unsigned int WorldDimensionsInVoxels = WorldDimension * TechnicalChunkDim;
 static constexpr float WorldDimensionsInVoxelsf = static_cast<float>(WorldDimensionsInVoxels);
 static constexpr float heightMapHeightInVoxels = 32.f * 5.f; 
@@ -17,3 +21,65 @@ static constexpr float invTechnicalChunkDim = 1.f / TechnicalChunkDim;
 static constexpr float chunkSpawnRadius = TechnicalChunkDim * chunkSpawnDistance;
 static constexpr float chunkDespawnRadius = chunkSpawnRadius * 1.5f;
 static constexpr double PI = 3.141592653589793238462643383279;
+
+// What happens to a chunk's voxel volume once its mesh has been built
+enum class VolumeResidency
+{
+  Resident,   // Kept in the VolumePool until the chunk is unloaded
+  Compressed, // Run-length encoded into the chunk, pool slot released
+  Dropped     // Pool slot released, volume regenerated if it's ever needed again
+};
+static constexpr VolumeResidency volumeResidency = VolumeResidency::Compressed;
+
+static constexpr unsigned int VolumesPerSlab = 64; // ~6MB per slab
+static constexpr unsigned int MaxVolumeSlabs = 96; // Enough to cover every chunk inside the despawn radius
+// Only chunks being generated hold a slot unless volumes are kept resident
+static constexpr unsigned int InitialVolumeSlabs = (volumeResidency == VolumeResidency::Resident) ? 24 : 1;
+static constexpr bool UseHugePagesForVolumes = true;
+
+// Chunk meshes are suballocated from pages of this many bytes, one set for vertices and one for indices
+static constexpr size_t ChunkBufferPageBytes = 64 * 1024 * 1024;
+// Each frame up to this many chunk meshes are moved down pages whose free space is more split up than the threshold
+static constexpr unsigned int ChunkBufferMovesPerFrame = 8;
+static constexpr double ChunkBufferDefragThreshold = 0.5;
+// Chunks drawn per frame, sizes each frame's model matrix and indirect command buffers
+static constexpr unsigned int MaxRenderedChunks = 256;
+
+// Keep an encoded copy of each chunk's mesh so cache hits can skip re-meshing,
+// false re-meshes from the cached volume instead (useful for comparing hit latency)
+static constexpr bool CacheMeshes = true;
+
+// Generate chunks ahead of a moving camera into the cache, see ChunkPrefetcher
+static constexpr bool PrefetchChunks = true; // Default, -noPrefetch turns it off
+static constexpr float PrefetchLookahead = 1.5f; // Seconds of camera movement to extrapolate
+static constexpr float PrefetchMinSpeed = 16.f; // Voxels per second, below this the spawn radius keeps up on its own
+static constexpr unsigned int PrefetchMaxInFlight = 4; // Never more prefetches than this running at once
+
+// Spawned chunks are queued and handed to workers best first, see ChunkScheduler
+static constexpr unsigned int ChunkJobsInFlightPerWorker = 2; // Enough to keep workers busy between updates
+static constexpr float OutOfViewPriorityScale = 2.f; // Chunks outside the view frustum count as this much further away
+static constexpr float SurfacePriorityWeight = 0.5f; // Per chunk of vertical distance from the heightmap surface
+static constexpr unsigned int TimeToVisibleChunks = 32; // Nearest chunks timed after a teleport
+
+// Streaming limits per update, whichever of the count or time runs out first. Anything over
+// waits in a backlog for the next update. Chunks spawn within chunkSpawnRadius but only go
+// once they're past chunkDespawnRadius, so one hovering around the boundary isn't thrashed
+static constexpr unsigned int MaxChunkSpawnsPerUpdate = 64; // Entities created
+static constexpr unsigned int ChunkSpawnBudgetUs = 1000;
+static constexpr unsigned int MaxChunkDespawnsPerUpdate = 64; // Entities destroyed, buffers retired
+static constexpr unsigned int ChunkDespawnBudgetUs = 1000;
+static constexpr unsigned int MaxChunkJobsStartedPerUpdate = 16; // Each ends in at most one mesh upload
+
+// Chunk builds run as a pipeline of stages, see ChunkPipeline. Every stage but the upload
+// runs on all the workers at once
+static constexpr unsigned int UploadStageConcurrency = 0; // Workers copying meshes into the staging ring at once, 0 for all of them
+static constexpr size_t BuildStageQueueCapacity = 32; // Builds waiting in front of a stage before the stage ahead of it stops being dispatched
+static constexpr size_t StagingRingBytes = 32 * 1024 * 1024; // Persistently mapped, shared by every mesh upload, see UploadBatcher
+
+// Chunk builds run ahead of prefetches and prefetches ahead of housekeeping, see PriorityExecutor
+static constexpr unsigned int ExecutorStarvationLimit = 16; // Tasks a worker takes in a row ahead of waiting lower priority work
+
+// Defaults for the thread layout, see ThreadTopology. Changed with -frameCores, -pinThreads and -numaLocal
+static constexpr unsigned int ReservedFrameCores = 2; // Main thread and the update thread, chunk workers get the rest
+static constexpr bool PinThreads = false;
+static constexpr bool NumaLocalThreads = false;
@@ -5,6 +5,9 @@
 #include <atomic>
 #include "common.hpp"
 #include "voxel.hpp"
+#include "VolumePool.hpp"
+#include "VolumeCodec.hpp"
+#include "MeshCodec.hpp"
 #include "VulkanInterface.hpp"
 
 struct VolumeData
@@ -32,8 +35,8 @@ struct VolumeData
   //  );
   //}
 
-  std::array<Voxel, ChunkSize> volume;
-  bool generating;
+  VolumeHandle volume; // Payload lives in the VolumePool while the chunk is being built
+  CompressedVolume compressed; // Holds the volume after meshing when volumeResidency is Compressed
 
   //void destroy()
   //{
@@ -45,12 +48,23 @@ struct VolumeData
   //}
 };
 
+static constexpr uint32_t InvalidChunkBufferPage = 0xFFFFFFFF;
+
+// Part of a ChunkBufferPool page, in elements, i.e. vertices or indices
+struct ChunkBufferRange
+{
+  uint32_t page = InvalidChunkBufferPage;
+  uint32_t block = 0; // Handle from the page's allocator
+  uint32_t offset = 0;
+  uint32_t count = 0;
+};
+
 struct ModelData
 {
-  VkBuffer vertexBuffer, indexBuffer;
-  VmaAllocation vbufferAllocation, ibufferAllocation;
+  VkBuffer vertexBuffer, indexBuffer; // Pages the ranges are in, shared with other chunks
   VmaAllocator * allocator;
   uint32_t indexCount;
+  ChunkBufferRange vertices, indices;
 
   //ModelData(VkBuffer vbuf, VkBuffer ibuf, VmaAllocation vbufAlloc, VmaAllocation ibufAlloc, VmaAllocator * allocator, uint32_t idc)
   //  : vertexBuffer(vbuf)
@@ -63,17 +77,16 @@ struct ModelData
   //  std::cout << allocator << std::endl;
   //}
 
-  void destroy()
-  {
-    vmaDestroyBuffer(*allocator, vertexBuffer, vbufferAllocation);
-    vmaDestroyBuffer(*allocator, indexBuffer, ibufferAllocation);
-  }
-
   ~ModelData()
   {
   }
 };
 
+struct MeshCacheData
+{
+  CompressedMesh mesh; // Encoded copy of the uploaded mesh, handed to the ChunkCache on unload when CacheMeshes is set
+};
+
 struct WorldPosition
 {
   glm::vec3 pos;
@@ -50,6 +50,18 @@ inline float sqrdToroidalDistance(glm::vec3 const p0, glm::vec3 const p1)
   return glm::dot(delta, delta);
 }
 
+// Shortest signed offset from p0 to p1, wrapping on x and z like sqrdToroidalDistance
+inline glm::vec3 toroidalDelta(glm::vec3 const p0, glm::vec3 const p1)
+{
+  constexpr float halfWorldDim = WorldDimensionsInVoxelsf / 2.f;
+  glm::vec3 delta = p1 - p0;
+  if      (delta.x >  halfWorldDim) delta.x -= WorldDimensionsInVoxelsf;
+  else if (delta.x < -halfWorldDim) delta.x += WorldDimensionsInVoxelsf;
+  if      (delta.z >  halfWorldDim) delta.z -= WorldDimensionsInVoxelsf;
+  else if (delta.z < -halfWorldDim) delta.z += WorldDimensionsInVoxelsf;
+  return delta;
+}
+
 inline float sqrdDistance(glm::vec3 const p0, glm::vec3 const p1)
 {
   glm::vec3 delta = p1 - p0;
@@ -1,4 +1,7 @@
 #include "ComputeApp.hpp"
+#include "CacheReplay.hpp"
+#include "Benchmarks.hpp"
+#include <cstdlib>
 
 int main(int argc, char* argv[])
 {
@@ -7,15 +10,67 @@ int main(int argc, char* argv[])
 #endif
 
     bool metricsEnabled = false;
-    if (argc > 1)
+    bool recordCameraPath = false;
+    size_t cacheBudget = ChunkCacheBudgetBytes;
+    bool prefetch = PrefetchChunks;
+    char const * cameraPathToPlay = nullptr;
+    char const * cameraPathToReplay = nullptr;
+    ThreadTopologyConfig topology = { ReservedFrameCores, PinThreads, NumaLocalThreads };
+    for (int i = 1; i < argc; i++)
     {
-      if (strcmp(argv[1], "-metricsLogging") == 0)
+      if (strcmp(argv[i], "-metricsLogging") == 0)
       {
         metricsEnabled = true;
       }
+      else if (strcmp(argv[i], "-recordCameraPath") == 0)
+      {
+        recordCameraPath = true;
+      }
+      else if (strcmp(argv[i], "-playCameraPath") == 0 && i + 1 < argc)
+      {
+        cameraPathToPlay = argv[++i];
+      }
+      else if (strcmp(argv[i], "-noPrefetch") == 0)
+      {
+        prefetch = false;
+      }
+      else if (strcmp(argv[i], "-frameCores") == 0 && i + 1 < argc)
+      {
+        topology.frameCores = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+      }
+      else if (strcmp(argv[i], "-pinThreads") == 0)
+      {
+        topology.pin = true;
+      }
+      else if (strcmp(argv[i], "-numaLocal") == 0)
+      {
+        topology.numaLocal = true;
+      }
+      else if (strcmp(argv[i], "-cacheBudgetMB") == 0 && i + 1 < argc)
+      {
+        cacheBudget = static_cast<size_t>(std::strtoull(argv[++i], nullptr, 10)) * 1024 * 1024;
+      }
+      else if (strcmp(argv[i], "-replayCachePolicies") == 0 && i + 1 < argc)
+      {
+        cameraPathToReplay = argv[++i];
+      }
+      else if (strcmp(argv[i], "-bench") == 0 && i + 1 < argc)
+      {
+        // Headless tool, doesn't start the app
+        return RunBenchmark(argv[i + 1]) ? EXIT_SUCCESS : EXIT_FAILURE;
+      }
+    }
+
+    if (cameraPathToReplay)
+    {
+      // Headless tool, doesn't start the app. Run after parsing so -cacheBudgetMB applies wherever it's given
+      return ReplayCameraPathThroughCachePolicies(cameraPathToReplay, cacheBudget) ? EXIT_SUCCESS : EXIT_FAILURE;
     }
 
     ComputeApp app;
+    app.SetChunkCacheBudget(cacheBudget);
+    app.SetPrefetching(prefetch);
+    app.SetThreadTopology(topology);
     if (metricsEnabled)
     {
       if (!app.InitMetrics())
@@ -23,6 +78,20 @@ int main(int argc, char* argv[])
         return EXIT_FAILURE;
       }
     }
+    if (recordCameraPath)
+    {
+      if (!app.InitCameraPathRecording())
+      {
+        return EXIT_FAILURE;
+      }
+    }
+    if (cameraPathToPlay)
+    {
+      if (!app.InitCameraPathPlayback(cameraPathToPlay))
+      {
+        return EXIT_FAILURE;
+      }
+    }
     VulkanInterface::WindowFramework window("Compute Pipeline App", 0, 0, 1920, 1080, app);
     window.Render();
 
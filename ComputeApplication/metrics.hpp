@@ -1,4 +1,6 @@
 #pragma once
+#include <algorithm>
+#include <array>
 #include <chrono>
 #include <fstream>
 #include <string>
@@ -10,10 +12,12 @@ using std::chrono::duration_cast;
 using std::chrono::microseconds;
 using std::chrono::nanoseconds;
 
-inline std::ofstream createLogFile()
+inline std::ofstream createLogFile(std::string const & name = "LogMetrics")
 {
   std::string filename;
-  filename = "ComputeApp_LogMetrics_";
+  filename = "ComputeApp_";
+  filename.append(name);
+  filename.append("_");
   filename.append(std::to_string(static_cast<int64_t>(time(NULL))));
   filename.append(".log");
 
@@ -33,6 +37,7 @@ struct logEntryData
     , end;
   uint64_t key;
   bool loadedFromCache;
+  bool meshFromCache; // Cache hit skipped meshing entirely
 };
 
 inline void insertEntry(std::ofstream & logFile
@@ -49,3 +54,63 @@ inline void insertEntry(std::ofstream & logFile
           << duration_cast<nanoseconds>(data.end - data.registered).count()          << "," // timesinceRegistered
           << std::endl; // End of entry
 }
+
+// Cache hits are logged separately, surfaceStart to surfaceEnd covers the upload (and re-meshing if the mesh wasn't cached)
+inline void insertCacheHitEntry(std::ofstream & logFile
+  , logEntryData const data)
+{
+  synclog(logFile) << data.key << ","
+          << duration_cast<nanoseconds>(data.surfaceEnd - data.surfaceStart).count() << "," // restoreElapsed
+          << duration_cast<nanoseconds>(data.end - data.start).count()               << "," // timeElapsed
+          << duration_cast<nanoseconds>(data.end - data.registered).count()          << "," // timeSinceRegistered
+          << data.meshFromCache
+          << std::endl; // End of entry
+}
+
+// Counters are written in long format (time,counter,value) so new ones can
+// be added without changing the column headings
+inline void insertCounter(std::ofstream & logFile
+  , double const time
+  , char const * const counter
+  , uint64_t const value)
+{
+  synclog(logFile) << time << "," << counter << "," << value << std::endl;
+}
+
+// Frame times in 0.5ms buckets up to 100ms, anything slower goes in the last bucket.
+// Periodic stalls show up as a second hump well to the right of the main one
+class FrameTimeHistogram
+{
+public:
+  FrameTimeHistogram()
+  {
+    buckets.fill(0);
+  }
+
+  void record(double const ms)
+  {
+    size_t bucket = static_cast<size_t>(std::max(ms, 0.0) / BucketMs);
+    buckets[std::min(bucket, buckets.size() - 1)]++;
+    frames++;
+  }
+
+  uint64_t count() const { return frames; }
+
+  // One line per non-empty bucket, bucketStartMs,frames
+  void write(std::ofstream & logFile) const
+  {
+    synclog(logFile) << "bucketStartMs,frames" << std::endl;
+    for (size_t i = 0; i < buckets.size(); i++)
+    {
+      if (buckets[i] > 0)
+      {
+        synclog(logFile) << i * BucketMs << "," << buckets[i] << std::endl;
+      }
+    }
+  }
+
+private:
+  static constexpr double BucketMs = 0.5;
+  std::array<uint64_t, 201> buckets; // Last one is 100ms and over
+  uint64_t frames = 0;
+};